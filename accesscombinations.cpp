@@ -19,10 +19,27 @@
 // For osmium::apply()
 #include <osmium/visitor.hpp>
 
+// For handing buffers to the counting threads
+#include <osmium/memory/buffer.hpp>
+#include <osmium/thread/queue.hpp>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
 #include <boost/program_options.hpp>
 
 namespace po = boost::program_options;
 
+static const char * const	dumptags[]={
+	"highway", "access", "vehicle", "motor_vehicle", "motorcycle",
+	"motorcar", "hgv", "psv", "bicycle", "foot", "agricultural",
+	"goods", "mofa", "moped", "horse"};
+
+static const size_t		dumptagcount=sizeof(dumptags)/sizeof(dumptags[0]);
+
 class WayHandler : public osmium::handler::Handler {
 	po::variables_map& vm;
 	public:
@@ -35,11 +52,6 @@ class WayHandler : public osmium::handler::Handler {
 				return;
 			}
 
-			std::vector<const char *>	dumptags={
-				"highway", "access", "vehicle", "motor_vehicle", "motorcycle",
-				"motorcar", "hgv", "psv", "bicycle", "foot", "agricultural",
-				"goods", "mofa", "moped", "horse"};
-
 				if (vm["wayid"].as<bool>()) {
 					std::cout << way.id() << " ";
 				}
@@ -49,11 +61,180 @@ class WayHandler : public osmium::handler::Handler {
 						continue;
 					std::cout << key << "=" << value << " ";
 				}
-				std::cout << std::endl;
+				std::cout << '\n';
 			}
 };
 
+/*
+ * Aggregation mode - instead of one line per way every distinct combination
+ * of the dumptags values is counted. The values are numbered per key so a
+ * combination is a tuple of value ids, 0 meaning the key is missing.
+ */
+using combination = std::array<uint32_t, dumptagcount>;
+
+struct CombinationHash {
+	size_t operator()(const combination& c) const {
+		uint64_t	hash=14695981039346656037ULL;
+
+		for(auto id : c) {
+			hash=(hash ^ id) * 1099511628211ULL;
+		}
+		return hash;
+	}
+};
+
+using combination_counts = std::unordered_map<combination, uint64_t, CombinationHash>;
 
+// Interned values are looked up by the tag value itself without a copy
+struct ValueHash {
+	size_t operator()(const char *value) const {
+		uint64_t	hash=14695981039346656037ULL;
+
+		for(;*value;value++) {
+			hash=(hash ^ static_cast<unsigned char>(*value)) * 1099511628211ULL;
+		}
+		return hash;
+	}
+};
+
+struct ValueEqual {
+	bool operator()(const char *a, const char *b) const {
+		return std::strcmp(a, b) == 0;
+	}
+};
+
+class ValueIds {
+	// Keys point into values - a deque never moves its strings
+	std::unordered_map<const char *, uint32_t, ValueHash, ValueEqual>	ids;
+
+	public:
+		std::deque<std::string>		values{""};
+
+		ValueIds()=default;
+		ValueIds(const ValueIds&)=delete;
+		ValueIds& operator=(const ValueIds&)=delete;
+
+		uint32_t id(const char *value) {
+			auto	it=ids.find(value);
+
+			if (it != ids.end())
+				return it->second;
+
+			values.push_back(value);
+			ids.emplace(values.back().c_str(), values.size()-1);
+
+			return values.size()-1;
+		}
+};
+
+class AggregateHandler : public osmium::handler::Handler {
+	public:
+		std::array<ValueIds, dumptagcount>	values;
+		combination_counts			counts;
+
+		void way(const osmium::Way& way) {
+			const osmium::TagList&	taglist=way.tags();
+
+			if (!taglist.has_key("highway"))
+				return;
+
+			combination	c;
+			for(size_t i=0;i<dumptagcount;i++) {
+				const char *value=taglist.get_value_by_key(dumptags[i]);
+				c[i]=value ? values[i].id(value) : 0;
+			}
+			counts[c]++;
+		}
+
+		// Adds the counts of another thread - its value ids are numbered anew
+		void merge(const AggregateHandler& other) {
+			std::array<std::vector<uint32_t>, dumptagcount>	translate;
+
+			for(size_t i=0;i<dumptagcount;i++) {
+				translate[i].push_back(0);
+				for(size_t id=1;id<other.values[i].values.size();id++) {
+					translate[i].push_back(values[i].id(other.values[i].values[id].c_str()));
+				}
+			}
+
+			for(const auto& count : other.counts) {
+				combination	c;
+				for(size_t i=0;i<dumptagcount;i++) {
+					c[i]=translate[i][count.first[i]];
+				}
+				counts[c]+=count.second;
+			}
+		}
+
+		std::string format(const combination& c) const {
+			std::string	line;
+
+			for(size_t i=0;i<dumptagcount;i++) {
+				if (!c[i])
+					continue;
+				line.append(dumptags[i]).append("=").append(values[i].values[c[i]]).append(" ");
+			}
+			return line;
+		}
+
+		// Most frequent first like sort | uniq -c | sort -rn
+		void print(std::ostream& out) const {
+			std::vector<std::pair<uint64_t, std::string>>	lines;
+
+			for(const auto& count : counts) {
+				lines.emplace_back(count.second, format(count.first));
+			}
+
+			std::sort(lines.begin(), lines.end(), [](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b) {
+				return a.first > b.first || (a.first == b.first && a.second < b.second);
+			});
+
+			for(const auto& line : lines) {
+				out << line.first << " " << line.second << '\n';
+			}
+		}
+};
+
+/*
+ * The buffers are read on the main thread and counted on the others. Each
+ * thread has its own counts which are merged at the end.
+ */
+static void aggregate(osmium::io::Reader& reader, unsigned int threads, std::ostream& out) {
+	std::vector<AggregateHandler>			handlers(threads ? threads : 1);
+	osmium::thread::Queue<osmium::memory::Buffer>	queue(handlers.size()*2, "aggregate");
+	std::vector<std::thread>			workers;
+
+	for(auto& handler : handlers) {
+		workers.emplace_back([&queue, &handler]() {
+			while (true) {
+				osmium::memory::Buffer	buffer;
+				queue.wait_and_pop(buffer);
+
+				// An invalid buffer marks the end of input
+				if (!buffer)
+					return;
+
+				osmium::apply(buffer, handler);
+			}
+		});
+	}
+
+	while (osmium::memory::Buffer buffer=reader.read()) {
+		queue.push(std::move(buffer));
+	}
+
+	for(size_t i=0;i<workers.size();i++) {
+		queue.push(osmium::memory::Buffer{});
+	}
+	for(auto& t : workers) {
+		t.join();
+	}
+
+	for(size_t i=1;i<handlers.size();i++) {
+		handlers[0].merge(handlers[i]);
+	}
+	handlers[0].print(out);
+}
 
 int main(int argc, char* argv[]) {
 	po::options_description         desc("Allowed options");
@@ -61,6 +242,8 @@ int main(int argc, char* argv[]) {
                 ("help,h", "produce help message")
                 ("infile,i", po::value<std::string>()->required(), "Input file")
                 ("wayid,w", po::bool_switch(), "Display wayid")
+                ("aggregate,a", po::bool_switch(), "Count each combination once sorted by frequency instead of a line per way")
+                ("threads,t", po::value<unsigned int>()->default_value(1), "Number of threads counting with --aggregate")
         ;
         po::variables_map vm;
 
@@ -78,16 +261,26 @@ int main(int argc, char* argv[]) {
                 return 1;
         }
 
+	if (vm["aggregate"].as<bool>() && vm["wayid"].as<bool>()) {
+		std::cout << "Error: --wayid can not be used with --aggregate\n";
+		exit(-1);
+	}
+
 	// Initialize an empty DynamicHandler. Later it will be associated
 	// with one of the handlers. You can think of the DynamicHandler as
 	// a kind of "variant handler" or a "pointer handler" pointing to the
 	// real handler.
 	osmium::io::File input_file{vm["infile"].as<std::string>()};
 
-	WayHandler	handler(vm);
+	// Only the tags of the ways are needed
+	osmium::io::Reader reader{input_file, osmium::osm_entity_bits::way};
+
+	if (vm["aggregate"].as<bool>()) {
+		aggregate(reader, vm["threads"].as<unsigned int>(), std::cout);
+	} else {
+		WayHandler	handler(vm);
+		osmium::apply(reader, handler);
+	}
 
-	osmium::io::Reader reader{input_file};
-	osmium::apply(reader, handler);
 	reader.close();
 }
-
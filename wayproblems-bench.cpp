@@ -0,0 +1,513 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <new>
+
+// For building the synthetic ways
+#include <osmium/builder/attr.hpp>
+
+// For writing the generated pbf
+#include <osmium/io/any_output.hpp>
+
+#include <boost/program_options.hpp>
+
+#include "wayproblems.hpp"
+
+/*
+ * Benchmarks for the way checks.
+ *
+ * The first part runs every check of WayHandler on a set of synthetic ways
+ * and reports the time per way. The second part generates a pbf with a
+ * configurable number of ways and measures the ways/s of the whole
+ * read/locations/checks pipeline.
+ */
+
+using tagset = std::vector<std::pair<const char *, const char *>>;
+
+// Every allocation is counted to show the checks do not allocate
+static std::atomic<size_t>	allocations{0};
+
+void *operator new(size_t size) {
+	allocations++;
+	if (void *p=malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+// A mix of common and broken tagging
+static const std::vector<tagset> tagsets {
+	{ { "highway", "residential" }, { "name", "Hauptstrasse" }, { "maxspeed", "30" }, { "sidewalk", "both" } },
+	{ { "highway", "primary" }, { "ref", "B 1" }, { "lanes", "3" }, { "lanes:forward", "2" }, { "lanes:backward", "1" },
+		{ "turn:lanes:forward", "left|through;right" }, { "maxspeed", "70" }, { "oneway", "no" } },
+	{ { "highway", "track" }, { "tracktype", "grade2" }, { "surface", "asphalt" }, { "motor_vehicle", "no" } },
+	{ { "highway", "cycleway" }, { "bicycle", "designated" }, { "foot", "no" }, { "segregated", "yes" } },
+	{ { "highway", "service" }, { "name", "Parkplatz" }, { "access", "private" } },
+	{ { "highway", "footway" }, { "foot", "yes" }, { "lit", "yes" } },
+	{ { "highway", "secondary" }, { "maxspeed", "50" }, { "source:maxspeed", "DE:urban" }, { "maxheight", "3.8" },
+		{ "maxwidth", "2,5" }, { "layer", "1" }, { "bridge", "yes" } },
+	{ { "highway", "path" }, { "motorcar", "no" }, { "bicycle", "yes" }, { "cycleway", "track" } },
+	{ { "highway", "living_street" }, { "maxspeed", "walk" }, { "vehicle", "yes" } },
+	{ { "highway", "unclassified" }, { "junction", "roundabout" }, { "oneway", "yes" }, { "name", "Kreisel" } },
+	{ { "highway", "tertiary" }, { "lanes", "2" }, { "turn:lanes", "left|right" }, { "destination:lanes", "A|B" },
+		{ "overtaking", "no" }, { "hazmat", "no" }, { "cutting", "yes" } },
+	{ { "highway", "track" }, { "tracktype", "grade6" }, { "tunnel", "no" }, { "embankment", "yes" },
+		{ "cutting", "no" }, { "lit", "maybe" }, { "layer", "-1" } },
+	{ { "highway", "residential" }, { "maxspeed", "30" }, { "maxspeed:type", "DE:zone30" },
+		{ "construction", "minor" }, { "hazmat", "no" }, { "layer", "0" } },
+	{ { "highway", "bus_stop" } },
+	// Without problems but through the lane and maxspeed parsing
+	{ { "highway", "primary" }, { "ref", "B 2" }, { "lanes", "2" }, { "lanes:forward", "1" }, { "lanes:backward", "1" },
+		{ "turn:lanes:forward", "left;through" }, { "turn:lanes:backward", "through;right" },
+		{ "maxspeed", "70" }, { "maxspeed:hgv", "60" } },
+	{ { "highway", "residential" }, { "name", "Einbahnstrasse" }, { "oneway", "yes" }, { "lanes", "2" },
+		{ "turn:lanes", "left|through" }, { "change:lanes", "no|yes" }, { "width:lanes", "3|3.25" }, { "maxspeed", "30" } },
+};
+
+static const osmium::Timestamp	bench_timestamp{"2020-01-01T00:00:00Z"};
+
+static void add_bench_way(osmium::memory::Buffer& buffer, osmium::object_id_type id,
+		const tagset& tags, const std::vector<osmium::NodeRef>& nodes) {
+	using namespace osmium::builder::attr;
+
+	osmium::builder::add_way(buffer,
+		_id(id),
+		_version(1),
+		_cid(1),
+		_user("bench"),
+		_timestamp(bench_timestamp),
+		_nodes(nodes),
+		_tags(tags));
+}
+
+template <typename TFunction>
+static double ns_per_way(size_t iterations, size_t ways, TFunction function) {
+	auto start=std::chrono::steady_clock::now();
+
+	for(size_t i=0;i<iterations;i++) {
+		function();
+	}
+
+	std::chrono::duration<double, std::nano>	duration=std::chrono::steady_clock::now()-start;
+
+	return duration.count()/(iterations*ways);
+}
+
+static void bench_checks(size_t iterations, const std::string& filter) {
+	osmium::memory::Buffer	buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+
+	osmium::object_id_type	id=1;
+	for(const auto& tags : tagsets) {
+		std::vector<osmium::NodeRef>	nodes;
+		for(int i=0;i<4;i++) {
+			nodes.emplace_back(id*10+i, osmium::Location{8.0+i*0.001, 52.0+id*0.001});
+		}
+		add_bench_way(buffer, id++, tags, nodes);
+	}
+
+	ProblemCollector	collector;
+	WayHandler		handler(collector);
+	size_t			ways=tagsets.size();
+
+	std::cout << std::left << std::setw(24) << "check" << std::right << std::setw(12) << "ns/way" << std::endl;
+
+	for(const auto& check : WayHandler::checks()) {
+		if (!filter.empty() && filter != check.name)
+			continue;
+
+		double ns=ns_per_way(iterations, ways, [&]() {
+			for(auto& way : buffer.select<osmium::Way>()) {
+				extendedTagList	taglist(way.tags());
+				(handler.*check.function)(way, taglist);
+			}
+			collector.discard();
+		});
+
+		std::cout << std::left << std::setw(24) << check.name
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << ns << std::endl;
+	}
+
+	if (filter.empty()) {
+		double ns=ns_per_way(iterations, ways, [&]() {
+			for(auto& way : buffer.select<osmium::Way>()) {
+				handler.check_way(way);
+			}
+			collector.discard();
+		});
+
+		std::cout << std::left << std::setw(24) << "all checks"
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << ns << std::endl;
+
+		// Problems allocate their message - the checks themselves must not
+		size_t	clean=0;
+		size_t	cleanallocations=0;
+		for(auto& way : buffer.select<osmium::Way>()) {
+			size_t	before=allocations;
+
+			handler.check_way(way);
+
+			if (!collector.pending()) {
+				clean++;
+				cleanallocations+=allocations-before;
+			}
+			collector.discard();
+		}
+
+		std::cout << std::left << std::setw(24) << "allocs/clean way"
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(1)
+			<< (clean ? double(cleanallocations)/clean : 0.0) << std::endl;
+
+		// The synthetic ways repeat so every lookup after the first round is a hit
+		WayHandler	memohandler(collector, nullptr, CheckOptions{false, false, nullptr, 1024, nullptr, 0});
+
+		ns=ns_per_way(iterations, ways, [&]() {
+			for(auto& way : buffer.select<osmium::Way>()) {
+				memohandler.check_way(way);
+			}
+			collector.discard();
+		});
+
+		std::cout << std::left << std::setw(24) << "all checks memo"
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << ns << std::endl;
+	}
+}
+
+// Keys the checks look up most often - a way sees about a hundred lookups
+static const char * const lookup_keys[] {
+	"highway", "bicycle", "oneway", "maxspeed", "name", "foot", "lanes", "access", "ref", "junction"
+};
+static const size_t	lookup_rounds=10;
+
+/*
+ * Tag lookups as done by the checks - scanning the TagList for every key
+ * against the per way index of extendedTagList including building it.
+ */
+static void bench_lookup(size_t iterations) {
+	osmium::memory::Buffer	buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+
+	osmium::object_id_type	id=1;
+	for(const auto& tags : tagsets) {
+		add_bench_way(buffer, id++, tags, { osmium::NodeRef{1}, osmium::NodeRef{2} });
+	}
+
+	size_t	ways=tagsets.size();
+	size_t	found=0;
+
+	double scan=ns_per_way(iterations, ways, [&]() {
+		for(auto& way : buffer.select<osmium::Way>()) {
+			for(size_t i=0;i<lookup_rounds;i++) {
+				for(auto key : lookup_keys) {
+					found+=way.tags().get_value_by_key(key) != nullptr;
+				}
+			}
+		}
+	});
+
+	double indexed=ns_per_way(iterations, ways, [&]() {
+		for(auto& way : buffer.select<osmium::Way>()) {
+			extendedTagList	taglist(way.tags());
+
+			for(size_t i=0;i<lookup_rounds;i++) {
+				for(auto key : lookup_keys) {
+					found+=taglist.has_key(key);
+				}
+			}
+		}
+	});
+
+	std::cout << std::endl
+		<< std::left << std::setw(24) << "lookup taglist"
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << scan << std::endl
+		<< std::left << std::setw(24) << "lookup index"
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << indexed << std::endl;
+
+	// Keep the lookups from being optimized away
+	if (found == 0)
+		std::cout << "no keys found" << std::endl;
+}
+
+/*
+ * The checks which moved to the default rules as they were written in
+ * WayHandler before. Only kept to compare the rule dispatch against.
+ */
+static void hardcoded_rules(osmium::Way& way, extendedTagList& taglist, ProblemCollector& writer) {
+	if (taglist.has_key("layer")) {
+		if (!taglist.key_value_is_int("layer")) {
+			writer.writeWay(L_WP, way, "default", "layer=%s is not integer", taglist.get_value_by_key("layer"));
+		} else {
+			int layer=taglist.key_value_as_int("layer");
+			if (layer == 0) {
+				writer.writeWay(L_DEFAULTS, way, "redundant", "layer=%s is default", taglist.get_value_by_key("layer"));
+			} else if (layer > 10) {
+				writer.writeWay(L_WP, way, "redundant", "layer=%s where num > 10 seems broken", taglist.get_value_by_key("layer"));
+			} else if (layer < -10) {
+				writer.writeWay(L_WP, way, "redundant", "layer=%s where num < -10 seems broken", taglist.get_value_by_key("layer"));
+			}
+		}
+	}
+
+	for(auto key : { "maxspeed:type", "source:maxspeed" }) {
+		if (taglist.has_key(key) && !taglist.key_value_in_list(key, {
+				"sign", "signals",
+				"DE:motorway", "DE:urban", "DE:rural",
+				"DE:zone", "DE:bicycle_road",
+				"DE:zone30", "DE:zone:30",
+				"DE:zone20", "DE:zone:20",
+				"DE:zone10", "DE:zone:10",
+			})) {
+			writer.writeWay(L_WP, way, "steelline", "%s=%s is unknown", key, taglist.get_value_by_key(key));
+		}
+	}
+
+	if (taglist.has_key("construction")) {
+		if (taglist.has_key_value("construction", "yes")) {
+			writer.writeWay(L_WP, way, "redundant", "construction=yes is deprecated");
+		} else if (taglist.has_key_value("construction", "no")) {
+			writer.writeWay(L_DEFAULTS, way, "redundant", "construction=no is default");
+		}
+
+		if (!taglist.key_value_in_list("construction", {
+				"yes", "no", "widening", "minor",
+				"motorway", "motorway_link", "trunk", "trunk_link",
+				"primary", "primary_link", "secondary", "secondary_link",
+				"tertiary", "tertiary_link", "unclassified",
+				"residential", "pedestrian", "service", "track", "cycleway", "footway",
+				"steps", "path" })) {
+			writer.writeWay(L_WP, way, "default", "construction=%s not in known list", taglist.get_value_by_key("construction"));
+		}
+	}
+
+	if (taglist.has_key("tracktype")) {
+		if (!taglist.key_value_in_list("tracktype", { "grade1", "grade2", "grade3", "grade4", "grade5" })) {
+			writer.writeWay(L_WP, way, "brownline", "tracktype=%s is unknown",
+				taglist.get_value_by_key("tracktype"));
+		}
+	}
+
+	if (taglist.key_value_is_false("tunnel")) {
+		writer.writeWay(L_DEFAULTS, way, "redundant", "tunnel=no ist default");
+	}
+
+	if (taglist.has_key("cutting")) {
+		if (!taglist.key_value_in_list("cutting", { "no", "yes", "1", "0", "true", "false", "left", "right" })) {
+			writer.writeWay(L_WP, way, "default", "cutting=%s is not in known value list",
+				taglist["cutting"]);
+		}
+		if (taglist.key_value_in_list("cutting", { "no", "0", "false" })) {
+			writer.writeWay(L_DEFAULTS, way, "default", "cutting=no is default");
+		}
+	}
+
+	if (taglist.has_key("embankment")) {
+		if (!taglist.key_value_in_list("embankment", { "no", "yes", "1", "0", "true", "false" })) {
+			writer.writeWay(L_WP, way, "default", "embankment=%s is not in known value list",
+				taglist["embankment"]);
+		}
+		if (taglist.key_value_in_list("embankment", { "no", "0", "false" })) {
+			writer.writeWay(L_DEFAULTS, way, "default", "embankment=no is default");
+		}
+	}
+
+	if (taglist.has_key("lit")) {
+		if (!taglist.key_value_in_list("lit", { "no", "yes", "limited", "24/7", "automatic" })) {
+			writer.writeWay(L_WP, way, "default", "lit=%s is not in known value list",
+				taglist.get_value_by_key("lit"));
+		}
+	}
+
+	if (taglist.has_key("hazmat")) {
+		if (!taglist.key_value_in_list("hazmat", { "no", "yes", "destination", "designated" })) {
+			writer.writeWay(L_WP, way, "default", "hazmat=%s is not in known value list",
+				taglist.get_value_by_key("hazmat"));
+		}
+	}
+}
+
+static void bench_rules(size_t iterations) {
+	osmium::memory::Buffer	buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+
+	osmium::object_id_type	id=1;
+	for(const auto& tags : tagsets) {
+		add_bench_way(buffer, id++, tags, { osmium::NodeRef{1}, osmium::NodeRef{2} });
+	}
+
+	ProblemCollector	collector;
+	const RuleSet&		rules=RuleSet::defaults();
+	size_t			ways=tagsets.size();
+
+	double hardcoded=ns_per_way(iterations, ways, [&]() {
+		for(auto& way : buffer.select<osmium::Way>()) {
+			extendedTagList	taglist(way.tags());
+			hardcoded_rules(way, taglist, collector);
+		}
+		collector.discard();
+	});
+
+	double dispatch=ns_per_way(iterations, ways, [&]() {
+		for(auto& way : buffer.select<osmium::Way>()) {
+			rules.check(way, collector);
+		}
+		collector.discard();
+	});
+
+	std::cout << std::endl
+		<< std::left << std::setw(24) << "rules hardcoded"
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << hardcoded << std::endl
+		<< std::left << std::setw(24) << "rules dispatch"
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(1) << dispatch << std::endl;
+}
+
+/*
+ * Generate a pbf with numways ways of nodesperway nodes. Consecutive ways
+ * share their end nodes. The tags are taken from the tagsets round robin.
+ */
+static void generate_pbf(const std::string& filename, size_t numways, size_t nodesperway) {
+	using namespace osmium::builder::attr;
+
+	osmium::io::Header	header;
+	osmium::io::Writer	writer{osmium::io::File{filename}, header, osmium::io::overwrite::allow};
+	osmium::memory::Buffer	buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+
+	size_t			numnodes=numways*(nodesperway-1)+1;
+
+	for(size_t n=1;n<=numnodes;n++) {
+		osmium::builder::add_node(buffer,
+			_id(n),
+			_version(1),
+			_cid(1),
+			_user("bench"),
+			_timestamp(bench_timestamp),
+			_location(6.0+(n%4000)*0.001, 50.0+(n/4000)*0.001));
+
+		if (buffer.committed() > 800*1024) {
+			writer(std::move(buffer));
+			buffer=osmium::memory::Buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+		}
+	}
+
+	for(size_t w=0;w<numways;w++) {
+		std::vector<osmium::NodeRef>	nodes;
+
+		for(size_t n=0;n<nodesperway;n++) {
+			nodes.emplace_back(w*(nodesperway-1)+n+1);
+		}
+		add_bench_way(buffer, w+1, tagsets[w % tagsets.size()], nodes);
+
+		if (buffer.committed() > 800*1024) {
+			writer(std::move(buffer));
+			buffer=osmium::memory::Buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+		}
+	}
+
+	writer(std::move(buffer));
+	writer.close();
+}
+
+/*
+ * Read the generated pbf, add the locations and optionally run the checks.
+ * Returns the number of problems found.
+ */
+static size_t run_pbf(const std::string& filename, bool checks, unsigned int threads) {
+	osmium::index::map::FlexMem<osmium::unsigned_object_id_type, osmium::Location>	index;
+	location_handler_type	location_handler{index};
+	osmium::io::Reader	reader{osmium::io::File{filename}};
+	size_t			problems=0;
+
+	location_handler.ignore_errors();
+
+	if (!checks) {
+		osmium::apply(reader, location_handler);
+	} else if (threads > 1) {
+		CheckWorkers					workers(threads);
+		std::deque<std::future<std::vector<WayProblems>>>	pending;
+
+		while (osmium::memory::Buffer buffer=reader.read()) {
+			osmium::apply(buffer, location_handler);
+			pending.push_back(workers.submit(std::move(buffer)));
+
+			while (pending.size() > threads*4) {
+				problems+=pending.front().get().size();
+				pending.pop_front();
+			}
+		}
+
+		for(auto& future : pending) {
+			problems+=future.get().size();
+		}
+	} else {
+		ProblemCollector	collector;
+		WayHandler		handler(collector);
+
+		while (osmium::memory::Buffer buffer=reader.read()) {
+			osmium::apply(buffer, location_handler, handler);
+			problems+=collector.release().size();
+		}
+	}
+
+	reader.close();
+	return problems;
+}
+
+static void bench_pbf(const std::string& filename, size_t numways, size_t nodesperway, unsigned int threads) {
+	generate_pbf(filename, numways, nodesperway);
+
+	auto start=std::chrono::steady_clock::now();
+	run_pbf(filename, false, threads);
+	std::chrono::duration<double>	readtime=std::chrono::steady_clock::now()-start;
+
+	start=std::chrono::steady_clock::now();
+	size_t problems=run_pbf(filename, true, threads);
+	std::chrono::duration<double>	checktime=std::chrono::steady_clock::now()-start;
+
+	std::cout << std::endl
+		<< "pbf " << filename << " ways " << numways << " nodes/way " << nodesperway
+		<< " threads " << threads << std::endl
+		<< std::fixed << std::setprecision(0)
+		<< "read+locations        " << numways/readtime.count() << " ways/s" << std::endl
+		<< "read+locations+checks " << numways/checktime.count() << " ways/s" << std::endl
+		<< "ways with problems    " << problems << std::endl;
+}
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+
+	po::options_description         desc("Allowed options");
+        desc.add_options()
+                ("help,h", "produce help message")
+		("iterations,n", po::value<size_t>()->default_value(100000), "Iterations over the synthetic ways per check")
+		("check,c", po::value<std::string>()->default_value(""), "Only benchmark this check")
+		("ways,w", po::value<size_t>()->default_value(1000000), "Number of ways in the generated pbf - 0 skips the pbf benchmark")
+		("nodes", po::value<size_t>()->default_value(8), "Number of nodes per way in the generated pbf")
+		("pbf,p", po::value<std::string>()->default_value("wayproblems-bench.osm.pbf"), "Filename of the generated pbf")
+		("threads,t", po::value<unsigned int>()->default_value(1), "Number of threads running the checks")
+        ;
+        po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	} catch(boost::program_options::error& e) {
+		std::cerr << "Error: " << e.what() << "\n";
+		exit(-1);
+	}
+
+        if (vm.count("help")) {
+                std::cout << desc << "\n";
+                return 1;
+        }
+
+	bench_checks(vm["iterations"].as<size_t>(), vm["check"].as<std::string>());
+	if (vm["check"].as<std::string>().empty()) {
+		bench_rules(vm["iterations"].as<size_t>());
+		bench_lookup(vm["iterations"].as<size_t>());
+	}
+
+	size_t	ways=vm["ways"].as<size_t>();
+	size_t	nodes=vm["nodes"].as<size_t>();
+	if (ways > 0 && nodes > 1) {
+		bench_pbf(vm["pbf"].as<std::string>(), ways, nodes, vm["threads"].as<unsigned int>());
+	}
+}
@@ -115,4 +115,69 @@ INSERT INTO "meta" VALUES('layer.defaults.popup', ( readfile('wayproblems-meta.p
 
 
 
+INSERT INTO "meta" VALUES('layer.layering.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.layering.srid','4326');
+INSERT INTO "meta" VALUES('layer.layering.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.layering.columns:0','id');
+INSERT INTO "meta" VALUES('layer.layering.columns:1','other');
+INSERT INTO "meta" VALUES('layer.layering.columns:2','problem');
+INSERT INTO "meta" VALUES('layer.layering.columns:3','style');
+INSERT INTO "meta" VALUES('layer.layering.popup', ( readfile('wayproblems-meta-network.popup' )) );
+
+
+
+INSERT INTO "meta" VALUES('layer.crossing.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.crossing.srid','4326');
+INSERT INTO "meta" VALUES('layer.crossing.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.crossing.columns:0','id');
+INSERT INTO "meta" VALUES('layer.crossing.columns:1','other');
+INSERT INTO "meta" VALUES('layer.crossing.columns:2','problem');
+INSERT INTO "meta" VALUES('layer.crossing.columns:3','style');
+INSERT INTO "meta" VALUES('layer.crossing.popup', ( readfile('wayproblems-meta-network.popup' )) );
+
+
+
+INSERT INTO "meta" VALUES('layer.island.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.island.srid','4326');
+INSERT INTO "meta" VALUES('layer.island.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.island.columns:0','id');
+INSERT INTO "meta" VALUES('layer.island.columns:1','other');
+INSERT INTO "meta" VALUES('layer.island.columns:2','problem');
+INSERT INTO "meta" VALUES('layer.island.columns:3','style');
+INSERT INTO "meta" VALUES('layer.island.popup', ( readfile('wayproblems-meta-network.popup' )) );
+
+
+
+INSERT INTO "meta" VALUES('layer.onewaytrap.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.onewaytrap.srid','4326');
+INSERT INTO "meta" VALUES('layer.onewaytrap.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.onewaytrap.columns:0','id');
+INSERT INTO "meta" VALUES('layer.onewaytrap.columns:1','problem');
+INSERT INTO "meta" VALUES('layer.onewaytrap.columns:2','style');
+INSERT INTO "meta" VALUES('layer.onewaytrap.popup', ( readfile('wayproblems-meta-network.popup' )) );
+
+
+
+INSERT INTO "meta" VALUES('layer.junctionangle.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.junctionangle.srid','4326');
+INSERT INTO "meta" VALUES('layer.junctionangle.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.junctionangle.columns:0','id');
+INSERT INTO "meta" VALUES('layer.junctionangle.columns:1','other');
+INSERT INTO "meta" VALUES('layer.junctionangle.columns:2','problem');
+INSERT INTO "meta" VALUES('layer.junctionangle.columns:3','style');
+INSERT INTO "meta" VALUES('layer.junctionangle.popup', ( readfile('wayproblems-meta-network.popup' )) );
+
+
+
+INSERT INTO "meta" VALUES('layer.nodes.geometrycolumn','geometry');
+INSERT INTO "meta" VALUES('layer.nodes.srid','4326');
+INSERT INTO "meta" VALUES('layer.nodes.stylecolumn','style');
+INSERT INTO "meta" VALUES('layer.nodes.columns:0','id');
+INSERT INTO "meta" VALUES('layer.nodes.columns:1','other');
+INSERT INTO "meta" VALUES('layer.nodes.columns:2','problem');
+INSERT INTO "meta" VALUES('layer.nodes.columns:3','style');
+INSERT INTO "meta" VALUES('layer.nodes.popup', ( readfile('wayproblems-meta-node.popup' )) );
+
+
+
 COMMIT;
@@ -0,0 +1,5281 @@
+#ifndef WAYPROBLEMS_HPP
+#define WAYPROBLEMS_HPP
+
+#include <cerrno>
+#include <cstdlib>  // for std::exit
+#include <cstring>  // for std::strcmp
+#include <iostream> // for std::cout, std::cerr
+#include <limits>     // for Nan
+
+// For the DynamicHandler class
+#include <osmium/dynamic_handler.hpp>
+
+// For the WKT factory
+#include <osmium/geom/wkt.hpp>
+#include <osmium/geom/ogr.hpp>
+#include <osmium/osm/way.hpp>
+
+// For the Dump handler
+#include <osmium/handler/dump.hpp>
+
+// For the NodeLocationForWays handler
+#include <osmium/handler/node_locations_for_ways.hpp>
+
+// Allow any format of input files (XML, PBF, ...)
+#include <osmium/io/any_input.hpp>
+
+// For osmium::apply()
+#include <osmium/visitor.hpp>
+
+// For handing buffers to the check threads
+#include <osmium/memory/buffer.hpp>
+#include <osmium/thread/queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+// For mapping the result cache
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// For the location index. There are different types of indexes available,
+// the one used is selected at runtime with --index.
+#include <osmium/index/map/all.hpp>
+
+// For the node id set in the two pass mode
+#include <osmium/index/id_set.hpp>
+
+#include <gdalcpp.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+// The base type of all location indexes - The actual type is created by the map factory
+using index_type = osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location>;
+
+// The location handler always depends on the index type
+using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
+
+#define DEBUG 0
+
+enum layerid {
+	L_WP,
+	L_REF,
+	L_FOOTWAY,
+	L_DEFAULTS,
+	L_STRANGE,
+	L_CYCLING,
+	layermax
+};
+
+// The table names of the layers - indexed by layerid
+static const char * const layer_names[layermax] {
+	"wayproblems",
+	"ref",
+	"footway",
+	"defaults",
+	"strange",
+	"cycling"
+};
+
+/*
+ * The problems found on a way. Everything needed for the output is copied
+ * from the way so the problems can outlive the buffer they were found in
+ * and be passed from a check thread to the writer. The geometry is built
+ * once and shared by all problems of the way.
+ */
+struct Problem {
+	layerid				lid;
+	const char			*style;
+	std::string			problem;
+};
+
+struct WayProblems {
+	osmium::object_id_type		id;
+	osmium::changeset_id_type	changeset;
+	osmium::object_version_type	version;
+	std::string			user;
+	std::string			timestamp;
+	std::vector<Problem>		problems;
+	std::unique_ptr<OGRLineString>	linestring;
+
+	// Only kept for databases which can be updated (--updatable)
+	std::vector<osmium::object_id_type>	nodes;
+};
+
+/*
+ * The network checks look at more than one way e.g. crossings. They run
+ * after all ways were read and write to their own layers as the problem
+ * belongs to a place and not to a single way.
+ */
+enum netlayerid {
+	N_LAYERING,
+	N_CROSSING,
+	N_ISLAND,
+	N_ONEWAY,
+	N_ANGLE,
+	N_NODE,
+	netlayermax
+};
+
+static const char * const network_layer_names[netlayermax] {
+	"layering",
+	"crossing",
+	"island",
+	"onewaytrap",
+	"junctionangle",
+	"nodes"
+};
+
+static const OGRwkbGeometryType network_layer_types[netlayermax] {
+	wkbPoint,
+	wkbPoint,
+	wkbLineString,
+	wkbLineString,
+	wkbPoint,
+	wkbPoint
+};
+
+// What the id of a problem is
+static const char * const network_layer_objects[netlayermax] {
+	"way",
+	"way",
+	"way",
+	"way",
+	"way",
+	"node"
+};
+
+struct NetworkProblem {
+	netlayerid			lid;
+	const char			*style;
+	std::string			problem;
+	osmium::object_id_type		id;		// Way or node - see network_layer_objects
+	osmium::object_id_type		other;		// The second way of a crossing - 0 otherwise
+	std::unique_ptr<OGRGeometry>	geometry;
+};
+
+/*
+ * The waynodes table stores the node ids of every way with problems as
+ * a space separated list. An update uses it to find the ways whose
+ * nodes moved.
+ */
+inline std::string format_nodes(const std::vector<osmium::object_id_type>& nodes) {
+	std::string	result;
+
+	for(auto id : nodes) {
+		if (!result.empty())
+			result+=' ';
+		result+=std::to_string(id);
+	}
+	return result;
+}
+
+inline std::vector<osmium::object_id_type> parse_nodes(const char *str) {
+	std::vector<osmium::object_id_type>	result;
+	char					*end;
+
+	while (*str) {
+		osmium::object_id_type id=strtoll(str, &end, 10);
+		if (end == str)
+			break;
+		result.push_back(id);
+		str=end;
+	}
+	return result;
+}
+
+class ProblemCollector {
+	osmium::geom::OGRFactory<>	m_factory{};
+	std::vector<Problem>		current;
+	std::vector<WayProblems>	ways;
+	bool				keepnodes;
+
+	public:
+	explicit ProblemCollector(bool keepnodes=false) : keepnodes(keepnodes) {};
+
+	void writeWay(layerid lid, const osmium::Way&, const char *style, const char *format, ...) {
+		char		problem[256];
+		va_list		args;
+
+		va_start(args, format);
+		vsnprintf (problem, 255, format, args);
+		va_end (args);
+
+		current.push_back(Problem{lid, style, problem});
+	}
+
+	// Called after all checks ran on the way
+	void finishWay(const osmium::Way& way) {
+		if (current.empty())
+			return;
+
+		try  {
+			WayProblems	wp;
+
+			wp.linestring=m_factory.create_linestring(way);
+
+			wp.id=way.id();
+			wp.changeset=way.changeset();
+			wp.version=way.version();
+			wp.user=way.user();
+			wp.timestamp=way.timestamp().to_iso();
+			wp.problems.swap(current);
+
+			if (keepnodes) {
+				wp.nodes.reserve(way.nodes().size());
+				for(const auto& nr : way.nodes()) {
+					wp.nodes.push_back(nr.ref());
+				}
+			}
+
+			ways.push_back(std::move(wp));
+		} catch (const osmium::invalid_location& e) {
+			std::cerr << "invalid location wayid " << way.id() << std::endl;
+		} catch (const osmium::geometry_error& e) {
+			std::cerr << "geometry error wayid " << way.id() << std::endl;
+		}
+
+		current.clear();
+	}
+
+	// Problems of the current way so far
+	size_t pending() const {
+		return current.size();
+	}
+
+	layerid pending_layer(size_t i) const {
+		return current[i].lid;
+	}
+
+	const Problem& pending_problem(size_t i) const {
+		return current[i];
+	}
+
+	// Problems from the result cache
+	void addProblem(Problem problem) {
+		current.push_back(std::move(problem));
+	}
+
+	// Drop the problems of the current way without building the geometry
+	void discard() {
+		current.clear();
+	}
+
+	std::vector<WayProblems> release() {
+		std::vector<WayProblems>	result;
+		result.swap(ways);
+		return result;
+	}
+};
+
+/*
+ * Result cache - Maps way id, version and a hash over the node locations
+ * to the problems of the last run. Unchanged ways replay these problems
+ * instead of running the checks. The file is written at the end of a run
+ * and mapped read only by the next one:
+ *
+ * header - "WPC1", number of styles (u32), rules hash (u64), number of ways (u64)
+ * styles - u16 length followed by the bytes, padded to 8 bytes
+ * ways   - CacheEntry sorted by id
+ * data   - For every way with problems at its offset: count (u16), then
+ *          per problem layer (u8), style (u8), u16 length and the text
+ *
+ * Ways without problems have the offset no_problems. All integers are in
+ * host byte order. A file written with other rules or another cache_version
+ * is ignored, a record which does not fit the file is taken as a miss.
+ */
+struct CacheEntry {
+	osmium::object_id_type	id;
+	uint64_t		lochash;
+	uint32_t		version;
+	uint32_t		offset;
+};
+
+class ResultCache {
+	public:
+	// Bump in every commit which changes the output of a check or the file format
+	// - the hash only covers it, the rules, the enabled checks and the number of layers
+	static constexpr uint32_t	cache_version=2;
+
+	private:
+	static constexpr uint32_t	no_problems=0xffffffff;
+	static constexpr size_t		header_size=24;
+
+	std::string			filename;
+	uint64_t			ruleshash;
+
+	// The cache of the last run
+	void				*map=nullptr;
+	size_t				mapsize=0;
+	const CacheEntry		*entries=nullptr;
+	size_t				numentries=0;
+	const char			*data=nullptr;
+	size_t				datasize=0;
+	std::vector<std::string>	oldstyles;
+
+	public:
+
+	// The entries for the next run - one per thread
+	class Builder {
+		ResultCache				&cache;
+		std::map<const char *, uint8_t>		styleindex;
+
+		public:
+		std::vector<CacheEntry>			entries;
+		std::string				data;
+		uint64_t				hits=0;
+		uint64_t				misses=0;
+
+		explicit Builder(ResultCache &cache) : cache(cache) {};
+
+		// Add the problems of the way from the last run to the collector
+		bool replay(const osmium::Way& way, uint64_t lochash, ProblemCollector& collector) {
+			const CacheEntry	*entry=cache.find(way.id(), way.version(), lochash);
+
+			if (!entry || (entry->offset != no_problems && !cache.replay(*entry, collector))) {
+				misses++;
+				return false;
+			}
+
+			hits++;
+			return true;
+		}
+
+		// Remember the problems found for the next run
+		void add(const osmium::Way& way, uint64_t lochash, const ProblemCollector& collector) {
+			CacheEntry	entry{way.id(), lochash, way.version(), no_problems};
+
+			if (collector.pending()) {
+				std::string	record;
+				uint16_t	count=collector.pending();
+
+				record.append(reinterpret_cast<const char *>(&count), sizeof(count));
+				for(size_t i=0;i<collector.pending();i++) {
+					const Problem&	p=collector.pending_problem(i);
+					uint8_t		lid=p.lid;
+					uint16_t	len=p.problem.size();
+
+					auto it=styleindex.find(p.style);
+					if (it == styleindex.end()) {
+						int index=cache.intern(p.style);
+						if (index < 0)
+							return;
+						it=styleindex.emplace(p.style, index).first;
+					}
+
+					record.append(reinterpret_cast<const char *>(&lid), 1);
+					record.append(reinterpret_cast<const char *>(&it->second), 1);
+					record.append(reinterpret_cast<const char *>(&len), sizeof(len));
+					record.append(p.problem);
+				}
+
+				entry.offset=data.size();
+				data.append(record);
+			}
+
+			entries.push_back(entry);
+		}
+	};
+
+	private:
+
+	std::mutex			mutex;
+	std::deque<Builder>		builders;
+	std::vector<std::string>	styles;
+
+	// Index of the style in the new file - -1 if there are too many
+	int intern(const char *style) {
+		std::lock_guard<std::mutex>	lock(mutex);
+
+		for(size_t i=0;i<styles.size();i++) {
+			if (styles[i] == style)
+				return i;
+		}
+		if (styles.size() > 255)
+			return -1;
+
+		styles.push_back(style);
+		return styles.size()-1;
+	}
+
+	// Check the record before adding anything - a truncated or corrupt file is a miss
+	bool valid(const CacheEntry& entry) const {
+		const char	*p=data+entry.offset;
+		const char	*end=data+datasize;
+		uint16_t	count;
+
+		if (static_cast<size_t>(end-p) < sizeof(count))
+			return false;
+		memcpy(&count, p, sizeof(count));
+		p+=sizeof(count);
+
+		for(uint16_t i=0;i<count;i++) {
+			uint16_t	len;
+
+			if (end-p < 4)
+				return false;
+			if (static_cast<uint8_t>(p[0]) >= layermax || static_cast<uint8_t>(p[1]) >= oldstyles.size())
+				return false;
+
+			memcpy(&len, p+2, sizeof(len));
+			if (end-p-4 < len)
+				return false;
+			p+=4+len;
+		}
+		return true;
+	}
+
+	bool replay(const CacheEntry& entry, ProblemCollector& collector) const {
+		if (!valid(entry))
+			return false;
+
+		const char	*p=data+entry.offset;
+		uint16_t	count;
+
+		memcpy(&count, p, sizeof(count));
+		p+=sizeof(count);
+
+		for(uint16_t i=0;i<count;i++) {
+			uint8_t		lid=p[0];
+			uint8_t		style=p[1];
+			uint16_t	len;
+
+			memcpy(&len, p+2, sizeof(len));
+			collector.addProblem(Problem{static_cast<layerid>(lid), oldstyles[style].c_str(), std::string(p+4, len)});
+			p+=4+len;
+		}
+		return true;
+	}
+
+	bool load() {
+		int fd=open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat	st;
+		if (fstat(fd, &st) || st.st_size < static_cast<off_t>(header_size)) {
+			close(fd);
+			return false;
+		}
+
+		mapsize=st.st_size;
+		map=mmap(nullptr, mapsize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (map == MAP_FAILED) {
+			map=nullptr;
+			return false;
+		}
+
+		const char	*p=static_cast<const char *>(map);
+		const char	*end=p+mapsize;
+		uint32_t	numstyles;
+		uint64_t	hash, ways;
+
+		memcpy(&numstyles, p+4, sizeof(numstyles));
+		memcpy(&hash, p+8, sizeof(hash));
+		memcpy(&ways, p+16, sizeof(ways));
+
+		if (memcmp(p, "WPC1", 4) != 0 || hash != ruleshash)
+			return false;
+
+		p+=header_size;
+		for(uint32_t i=0;i<numstyles;i++) {
+			uint16_t	len;
+
+			if (p+sizeof(len) > end)
+				return false;
+			memcpy(&len, p, sizeof(len));
+			p+=sizeof(len);
+
+			if (p+len > end)
+				return false;
+			oldstyles.emplace_back(p, len);
+			p+=len;
+		}
+
+		size_t	pos=(p-static_cast<const char *>(map)+7) & ~static_cast<size_t>(7);
+		if (pos+ways*sizeof(CacheEntry) > mapsize)
+			return false;
+
+		entries=reinterpret_cast<const CacheEntry *>(static_cast<const char *>(map)+pos);
+		numentries=ways;
+		data=reinterpret_cast<const char *>(entries+numentries);
+		datasize=mapsize-pos-ways*sizeof(CacheEntry);
+
+		return true;
+	}
+
+	public:
+
+	ResultCache(const std::string& filename, uint64_t ruleshash) : filename(filename), ruleshash(ruleshash) {
+		if (!load()) {
+			entries=nullptr;
+			numentries=0;
+		}
+	}
+
+	~ResultCache() {
+		if (map)
+			munmap(map, mapsize);
+	}
+
+	// Way ids, versions and locations differ so hash them all
+	static uint64_t location_hash(const osmium::Way& way) {
+		uint64_t	hash=14695981039346656037ULL;
+
+		for(const auto& nr : way.nodes()) {
+			hash=(hash ^ static_cast<uint32_t>(nr.location().x())) * 1099511628211ULL;
+			hash=(hash ^ static_cast<uint32_t>(nr.location().y())) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	const CacheEntry *find(osmium::object_id_type id, uint32_t version, uint64_t lochash) const {
+		const CacheEntry *it=std::lower_bound(entries, entries+numentries, id,
+			[](const CacheEntry& entry, osmium::object_id_type id) { return entry.id < id; });
+
+		if (it == entries+numentries || it->id != id || it->version != version || it->lochash != lochash)
+			return nullptr;
+		if (it->offset != no_problems && it->offset >= datasize)
+			return nullptr;
+
+		return it;
+	}
+
+	// A new builder for each thread running checks
+	Builder& builder() {
+		std::lock_guard<std::mutex>	lock(mutex);
+
+		builders.emplace_back(*this);
+		return builders.back();
+	}
+
+	uint64_t hits() const {
+		uint64_t	result=0;
+		for(const auto& b : builders)
+			result+=b.hits;
+		return result;
+	}
+
+	uint64_t misses() const {
+		uint64_t	result=0;
+		for(const auto& b : builders)
+			result+=b.misses;
+		return result;
+	}
+
+	// Write the entries of all builders for the next run. The old file
+	// is still mapped so the new one is renamed over it.
+	void write() {
+		std::vector<CacheEntry>	all;
+		uint64_t		base=0;
+
+		for(const auto& b : builders) {
+			for(auto entry : b.entries) {
+				if (entry.offset != no_problems)
+					entry.offset+=base;
+				all.push_back(entry);
+			}
+			base+=b.data.size();
+		}
+
+		if (base >= no_problems) {
+			std::cerr << "Result cache too large - not written" << std::endl;
+			return;
+		}
+
+		std::sort(all.begin(), all.end(),
+			[](const CacheEntry& a, const CacheEntry& b) { return a.id < b.id; });
+
+		std::string	header("WPC1", 4);
+		uint32_t	numstyles=styles.size();
+		uint64_t	ways=all.size();
+
+		header.append(reinterpret_cast<const char *>(&numstyles), sizeof(numstyles));
+		header.append(reinterpret_cast<const char *>(&ruleshash), sizeof(ruleshash));
+		header.append(reinterpret_cast<const char *>(&ways), sizeof(ways));
+		for(const auto& style : styles) {
+			uint16_t	len=style.size();
+			header.append(reinterpret_cast<const char *>(&len), sizeof(len));
+			header.append(style);
+		}
+		header.resize((header.size()+7) & ~static_cast<size_t>(7), '\0');
+
+		std::string	tmpname=filename + ".new";
+		FILE		*f=fopen(tmpname.c_str(), "w");
+		if (!f) {
+			std::cerr << "Can not write result cache " << tmpname << std::endl;
+			return;
+		}
+
+		bool ok=fwrite(header.data(), header.size(), 1, f) == 1;
+		if (!all.empty())
+			ok=ok && fwrite(all.data(), sizeof(CacheEntry), all.size(), f) == all.size();
+		for(const auto& b : builders) {
+			if (!b.data.empty())
+				ok=ok && fwrite(b.data.data(), b.data.size(), 1, f) == 1;
+		}
+		ok=(fclose(f) == 0) && ok;
+
+		if (!ok || rename(tmpname.c_str(), filename.c_str())) {
+			std::cerr << "Can not write result cache " << filename << std::endl;
+			unlink(tmpname.c_str());
+		}
+	}
+};
+
+/*
+ * The problem stream on stdout. The output is collected in a buffer and
+ * written in large blocks instead of flushing every line.
+ *
+ * text   - One human readable line per problem
+ * jsonl  - One JSON object per line
+ * binary - A header "WPB1", the number of layers (u8) and the layer names,
+ *          then one record per problem: id (i64), changeset (u32),
+ *          version (u32), layer (u8), user, timestamp, style and problem.
+ *          Strings are a u16 length followed by the bytes. All integers
+ *          are little endian.
+ */
+class ProblemStream {
+	public:
+		enum format {
+			F_NONE,
+			F_TEXT,
+			F_JSONL,
+			F_BINARY
+		};
+
+	private:
+		static const size_t	buffersize=1024*1024;
+
+		format			fmt;
+		std::string		buffer;
+
+		template <typename T>
+		void append_le(T value, int bytes) {
+			for(int i=0;i<bytes;i++) {
+				buffer.push_back(static_cast<char>((static_cast<uint64_t>(value) >> (i*8)) & 0xff));
+			}
+		}
+
+		void append_string(const char *string, size_t len) {
+			if (len > 0xffff)
+				len=0xffff;
+			append_le(len, 2);
+			buffer.append(string, len);
+		}
+
+		void append_string(const std::string& string) {
+			append_string(string.data(), string.size());
+		}
+
+		void append_json(const char *key, const char *value) {
+			buffer.push_back('"');
+			buffer.append(key);
+			buffer.append("\":\"");
+			for(const char *c=value;*c;c++) {
+				switch(*c) {
+					case '"': buffer.append("\\\""); break;
+					case '\\': buffer.append("\\\\"); break;
+					case '\n': buffer.append("\\n"); break;
+					case '\t': buffer.append("\\t"); break;
+					default:
+						if (static_cast<unsigned char>(*c) < 0x20) {
+							char	escaped[8];
+							snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+							buffer.append(escaped);
+						} else {
+							buffer.push_back(*c);
+						}
+				}
+			}
+			buffer.push_back('"');
+		}
+
+		void append_json(const char *key, uint64_t value) {
+			buffer.push_back('"');
+			buffer.append(key);
+			buffer.append("\":");
+			buffer.append(std::to_string(value));
+		}
+
+	public:
+		explicit ProblemStream(format fmt) : fmt(fmt) {
+			buffer.reserve(buffersize);
+		}
+
+		~ProblemStream() {
+			flush();
+		}
+
+		static format parse_format(const std::string& name) {
+			if (name == "text")
+				return F_TEXT;
+			if (name == "jsonl")
+				return F_JSONL;
+			if (name == "binary")
+				return F_BINARY;
+			throw std::invalid_argument("unknown output format " + name);
+		}
+
+		void header(const std::array<std::string, layermax>& layername) {
+			if (fmt != F_BINARY)
+				return;
+
+			buffer.append("WPB1");
+			append_le(layermax, 1);
+			for(const auto& name : layername) {
+				append_string(name);
+			}
+		}
+
+		void write(const WayProblems& wp, const Problem& p, const std::string& layername) {
+			switch(fmt) {
+				case F_NONE:
+					return;
+				case F_TEXT:
+					buffer.append("way=").append(std::to_string(wp.id))
+						.append(" problem=\"").append(p.problem).append("\" || ")
+						.append(" changeset=").append(std::to_string(wp.changeset))
+						.append(" user=\"").append(wp.user).append("\"")
+						.append(" timestamp=").append(wp.timestamp)
+						.append(" layer=").append(layername)
+						.append(" version=").append(std::to_string(wp.version))
+						.push_back('\n');
+					break;
+				case F_JSONL:
+					buffer.push_back('{');
+					append_json("way", wp.id);
+					buffer.push_back(',');
+					append_json("problem", p.problem.c_str());
+					buffer.push_back(',');
+					append_json("changeset", wp.changeset);
+					buffer.push_back(',');
+					append_json("user", wp.user.c_str());
+					buffer.push_back(',');
+					append_json("timestamp", wp.timestamp.c_str());
+					buffer.push_back(',');
+					append_json("layer", layername.c_str());
+					buffer.push_back(',');
+					append_json("version", wp.version);
+					buffer.push_back(',');
+					append_json("style", p.style);
+					buffer.append("}\n");
+					break;
+				case F_BINARY:
+					append_le(wp.id, 8);
+					append_le(wp.changeset, 4);
+					append_le(wp.version, 4);
+					append_le(p.lid, 1);
+					append_string(wp.user);
+					append_string(wp.timestamp);
+					append_string(p.style, strlen(p.style));
+					append_string(p.problem);
+					break;
+			}
+
+			if (buffer.size() >= buffersize)
+				flush();
+		}
+
+		// The binary records only carry way problems so the network
+		// problems are left out there
+		void write(const NetworkProblem& p, const char *layername) {
+			switch(fmt) {
+				case F_NONE:
+				case F_BINARY:
+					return;
+				case F_TEXT:
+					buffer.append(network_layer_objects[p.lid]).append("=").append(std::to_string(p.id))
+						.append(" problem=\"").append(p.problem).append("\" || ")
+						.append(" other=").append(std::to_string(p.other))
+						.append(" layer=").append(layername)
+						.push_back('\n');
+					break;
+				case F_JSONL:
+					buffer.push_back('{');
+					append_json(network_layer_objects[p.lid], p.id);
+					buffer.push_back(',');
+					append_json("problem", p.problem.c_str());
+					buffer.push_back(',');
+					append_json("other", p.other);
+					buffer.push_back(',');
+					append_json("layer", layername);
+					buffer.push_back(',');
+					append_json("style", p.style);
+					buffer.append("}\n");
+					break;
+			}
+
+			if (buffer.size() >= buffersize)
+				flush();
+		}
+
+		void flush() {
+			if (buffer.empty())
+				return;
+			fwrite(buffer.data(), 1, buffer.size(), stdout);
+			fflush(stdout);
+			buffer.clear();
+		}
+};
+
+class SpatiaLiteWriter : public osmium::handler::Handler {
+	std::array<gdalcpp::Layer *, layermax>	layer;
+	std::array<std::string, layermax>	layername;
+
+	gdalcpp::Dataset		dataset;
+
+	// Shared geometry mode - One row with the geometry per way in the
+	// problemways layer and the problems in the problems table
+	std::unique_ptr<gdalcpp::Layer>	problemways;
+	std::unique_ptr<gdalcpp::Layer>	problemtable;
+
+	std::unique_ptr<gdalcpp::Layer>	stattable;
+
+	// The node ids of the ways for --updatable
+	std::unique_ptr<gdalcpp::Layer>	waynodes;
+
+	// Only created if the network checks run
+	std::array<std::unique_ptr<gdalcpp::Layer>, netlayermax>	networklayer;
+
+	ProblemStream			&stream;
+
+	public:
+
+	SpatiaLiteWriter(std::string &dbname, uint64_t batch, bool sharedgeometry, bool updatable, ProblemStream &stream) :
+			dataset("sqlite", dbname, gdalcpp::SRS{}, {  "SPATIALITE=TRUE", "INIT_WITH_EPSG=no" }),
+			stream(stream) {
+
+			dataset.exec("PRAGMA synchronous = OFF");
+
+			// Commit every batch features instead of a transaction per feature
+			if (batch)
+				dataset.enable_auto_transactions(batch);
+
+			for(int i=0;i<layermax;i++) {
+				addLineStringLayer(i, layer_names[i]);
+			}
+
+			if (sharedgeometry) {
+				problemways.reset(new gdalcpp::Layer(dataset, "problemways", wkbLineString));
+				problemways->add_field("id", OFTString, 20);
+				problemways->add_field("changeset", OFTString, 20);
+				problemways->add_field("user", OFTString, 20);
+				problemways->add_field("timestamp", OFTString, 20);
+				problemways->add_field("version", OFTString, 60);
+
+				problemtable.reset(new gdalcpp::Layer(dataset, "problems", wkbNone));
+				problemtable->add_field("id", OFTString, 20);
+				problemtable->add_field("layer", OFTString, 20);
+				problemtable->add_field("problem", OFTString, 60);
+				problemtable->add_field("style", OFTString, 20);
+			}
+
+			if (updatable) {
+				waynodes.reset(new gdalcpp::Layer(dataset, "waynodes", wkbNone));
+				waynodes->add_field("id", OFTString, 20);
+				waynodes->add_field("nodes", OFTString, 0);
+			}
+
+			stream.header(layername);
+		}
+
+	void addLineStringLayer(const int layerid, const char *name) {
+		gdalcpp::Layer *l=new gdalcpp::Layer(dataset, name, wkbLineString);
+
+		l->add_field("id", OFTString, 20);
+		l->add_field("key", OFTString, 20);
+		l->add_field("value", OFTString, 20);
+		l->add_field("changeset", OFTString, 20);
+		l->add_field("user", OFTString, 20);
+		l->add_field("timestamp", OFTString, 20);
+		l->add_field("problem", OFTString, 60);
+		l->add_field("version", OFTString, 60);
+		l->add_field("style", OFTString, 20);
+
+		layername[layerid]=name;
+		layer[layerid]=l;
+	}
+
+	void writeWay(WayProblems& wp) {
+		for(size_t i=0;i<wp.problems.size();i++) {
+			const Problem&			p=wp.problems[i];
+			std::unique_ptr<OGRGeometry>	geometry;
+
+			// The last problem may take the geometry - all others need a copy
+			if (i+1 == wp.problems.size()) {
+				geometry=std::move(wp.linestring);
+			} else {
+				geometry.reset(wp.linestring->clone());
+			}
+
+			try  {
+				gdalcpp::Feature feature{*layer[p.lid], std::move(geometry)};
+
+				feature.set_field("id", static_cast<double>(wp.id));
+				feature.set_field("user", wp.user.c_str());
+				feature.set_field("changeset", static_cast<double>(wp.changeset));
+				feature.set_field("timestamp", wp.timestamp.c_str());
+				feature.set_field("problem", p.problem.c_str());
+				feature.set_field("style", p.style);
+				feature.set_field("version", static_cast<double>(wp.version));
+
+				feature.add_to_layer();
+
+				stream.write(wp, p, layername[p.lid]);
+			} catch (const gdalcpp::gdal_error& e) {
+				std::cerr << "gdal_error while creating feature wayid " << wp.id << std::endl;
+			}
+		}
+	}
+
+	void writeSharedWay(WayProblems& wp) {
+		try  {
+			gdalcpp::Feature feature{*problemways, std::move(wp.linestring)};
+
+			feature.set_field("id", static_cast<double>(wp.id));
+			feature.set_field("user", wp.user.c_str());
+			feature.set_field("changeset", static_cast<double>(wp.changeset));
+			feature.set_field("timestamp", wp.timestamp.c_str());
+			feature.set_field("version", static_cast<double>(wp.version));
+
+			feature.add_to_layer();
+		} catch (const gdalcpp::gdal_error& e) {
+			std::cerr << "gdal_error while creating feature wayid " << wp.id << std::endl;
+			return;
+		}
+
+		std::string	id=std::to_string(wp.id);
+
+		for(const auto& p : wp.problems) {
+			bool ok=addTableRow(*problemtable, [&](OGRFeature& feature) {
+				feature.SetField("id", id.c_str());
+				feature.SetField("layer", layername[p.lid].c_str());
+				feature.SetField("problem", p.problem.c_str());
+				feature.SetField("style", p.style);
+			});
+
+			if (!ok) {
+				std::cerr << "gdal_error while creating problem wayid " << wp.id << std::endl;
+			}
+
+			stream.write(wp, p, layername[p.lid]);
+		}
+	}
+
+	// gdalcpp::Feature needs a geometry so rows of tables without
+	// one are written with plain OGR
+	template <typename TFunction>
+	bool addTableRow(gdalcpp::Layer& table, TFunction fill) {
+		OGRLayer&	l=table.get();
+		OGRFeature	*feature=OGRFeature::CreateFeature(l.GetLayerDefn());
+
+		fill(*feature);
+
+		bool ok=(l.CreateFeature(feature) == OGRERR_NONE);
+		OGRFeature::DestroyFeature(feature);
+
+		return ok;
+	}
+
+	const std::array<std::string, layermax>& layernames() const {
+		return layername;
+	}
+
+	// The --stats counters - kind is either check or layer
+	void writeStat(const char *kind, const std::string& name, uint64_t calls, uint64_t problems, double seconds) {
+		if (!stattable) {
+			stattable.reset(new gdalcpp::Layer(dataset, "stats", wkbNone));
+			stattable->add_field("kind", OFTString, 10);
+			stattable->add_field("name", OFTString, 40);
+			stattable->add_field("calls", OFTReal, 20);
+			stattable->add_field("problems", OFTReal, 20);
+			stattable->add_field("seconds", OFTReal, 20, 6);
+		}
+
+		addTableRow(*stattable, [&](OGRFeature& feature) {
+			feature.SetField("kind", kind);
+			feature.SetField("name", name.c_str());
+			feature.SetField("calls", static_cast<double>(calls));
+			feature.SetField("problems", static_cast<double>(problems));
+			feature.SetField("seconds", seconds);
+		});
+	}
+
+	void writeWayNodes(const WayProblems& wp) {
+		bool ok=addTableRow(*waynodes, [&](OGRFeature& feature) {
+			feature.SetField("id", std::to_string(wp.id).c_str());
+			feature.SetField("nodes", format_nodes(wp.nodes).c_str());
+		});
+
+		if (!ok) {
+			std::cerr << "gdal_error while creating waynodes wayid " << wp.id << std::endl;
+		}
+	}
+
+	void writeProblems(std::vector<WayProblems> ways) {
+		for(auto& wp : ways) {
+			if (waynodes)
+				writeWayNodes(wp);
+
+			if (problemways) {
+				writeSharedWay(wp);
+			} else {
+				writeWay(wp);
+			}
+		}
+	}
+
+	void addNetworkLayers() {
+		for(int i=0;i<netlayermax;i++) {
+			networklayer[i].reset(new gdalcpp::Layer(dataset, network_layer_names[i], network_layer_types[i]));
+			networklayer[i]->add_field("id", OFTString, 20);
+			networklayer[i]->add_field("other", OFTString, 20);
+			networklayer[i]->add_field("problem", OFTString, 60);
+			networklayer[i]->add_field("style", OFTString, 20);
+		}
+	}
+
+	void writeNetworkProblems(std::vector<NetworkProblem> problems) {
+		for(auto& p : problems) {
+			try  {
+				gdalcpp::Feature feature{*networklayer[p.lid], std::move(p.geometry)};
+
+				feature.set_field("id", static_cast<double>(p.id));
+				feature.set_field("other", static_cast<double>(p.other));
+				feature.set_field("problem", p.problem.c_str());
+				feature.set_field("style", p.style);
+
+				feature.add_to_layer();
+
+				stream.write(p, network_layer_names[p.lid]);
+			} catch (const gdalcpp::gdal_error& e) {
+				std::cerr << "gdal_error while creating feature wayid " << p.id << std::endl;
+			}
+		}
+	}
+};
+
+/*
+ * Runs the SpatiaLiteWriter on its own thread so writing the database
+ * overlaps with the checks. The problems of a buffer are queued as one
+ * batch. The queue is bounded so the checks can not run away from the
+ * writer and fill up the memory.
+ */
+class AsyncWriter {
+	SpatiaLiteWriter				&writer;
+	osmium::thread::Queue<std::vector<WayProblems>>	queue;
+	std::exception_ptr				error;
+	std::thread					thread;
+
+	void run() {
+		while (true) {
+			std::vector<WayProblems>	problems;
+			queue.wait_and_pop(problems);
+
+			// An empty batch marks the end
+			if (problems.empty())
+				return;
+
+			try {
+				writer.writeProblems(std::move(problems));
+			} catch (...) {
+				if (!error)
+					error=std::current_exception();
+			}
+		}
+	}
+
+	public:
+		AsyncWriter(SpatiaLiteWriter &writer, size_t queuesize) :
+			writer(writer), queue(queuesize, "writer"), thread(&AsyncWriter::run, this) {};
+
+		~AsyncWriter() {
+			if (thread.joinable()) {
+				queue.push(std::vector<WayProblems>{});
+				thread.join();
+			}
+		}
+
+		void writeProblems(std::vector<WayProblems> problems) {
+			if (!problems.empty())
+				queue.push(std::move(problems));
+		}
+
+		void close() {
+			queue.push(std::vector<WayProblems>{});
+			thread.join();
+
+			if (error)
+				std::rethrow_exception(error);
+		}
+};
+
+/*
+ * Update mode - Opens a database written with --updatable and replaces
+ * the rows of ways by way id in all layers. Everything runs in a single
+ * transaction which is committed by commit().
+ */
+class SpatiaLiteUpdater {
+	GDALDataset				*dataset;
+	std::array<OGRLayer *, layermax>	layer;
+
+	// Only present if the database was written with --shared-geometry
+	OGRLayer				*problemways;
+	OGRLayer				*problemtable;
+
+	OGRLayer				*waynodes;
+
+	ProblemStream				&stream;
+
+	void exec(const std::string& sql) {
+		OGRLayer *result=dataset->ExecuteSQL(sql.c_str(), nullptr, nullptr);
+		if (result)
+			dataset->ReleaseResultSet(result);
+	}
+
+	// All tables with an id column
+	std::vector<std::string> tables() const {
+		std::vector<std::string>	result(layer_names, layer_names+layermax);
+
+		if (problemways) {
+			result.push_back("problemways");
+			result.push_back("problems");
+		}
+		result.push_back("waynodes");
+
+		return result;
+	}
+
+	// All layers with the way geometry
+	std::vector<OGRLayer *> geometrylayers() const {
+		std::vector<OGRLayer *>	result(layer.begin(), layer.end());
+
+		if (problemways)
+			result.push_back(problemways);
+
+		return result;
+	}
+
+	template <typename TFunction>
+	bool addFeature(OGRLayer *l, OGRGeometry *geometry, TFunction fill) {
+		OGRFeature	*feature=OGRFeature::CreateFeature(l->GetLayerDefn());
+
+		if (geometry)
+			feature->SetGeometryDirectly(geometry);
+		fill(*feature);
+
+		bool ok=(l->CreateFeature(feature) == OGRERR_NONE);
+		OGRFeature::DestroyFeature(feature);
+
+		return ok;
+	}
+
+	void writeWay(WayProblems& wp) {
+		for(const auto& p : wp.problems) {
+			bool ok=addFeature(layer[p.lid], wp.linestring->clone(), [&](OGRFeature& feature) {
+				feature.SetField("id", static_cast<double>(wp.id));
+				feature.SetField("user", wp.user.c_str());
+				feature.SetField("changeset", static_cast<double>(wp.changeset));
+				feature.SetField("timestamp", wp.timestamp.c_str());
+				feature.SetField("problem", p.problem.c_str());
+				feature.SetField("style", p.style);
+				feature.SetField("version", static_cast<double>(wp.version));
+			});
+
+			if (!ok) {
+				std::cerr << "gdal_error while creating feature wayid " << wp.id << std::endl;
+			}
+
+			stream.write(wp, p, layer_names[p.lid]);
+		}
+	}
+
+	void writeSharedWay(WayProblems& wp) {
+		bool ok=addFeature(problemways, wp.linestring->clone(), [&](OGRFeature& feature) {
+			feature.SetField("id", static_cast<double>(wp.id));
+			feature.SetField("user", wp.user.c_str());
+			feature.SetField("changeset", static_cast<double>(wp.changeset));
+			feature.SetField("timestamp", wp.timestamp.c_str());
+			feature.SetField("version", static_cast<double>(wp.version));
+		});
+
+		if (!ok) {
+			std::cerr << "gdal_error while creating feature wayid " << wp.id << std::endl;
+			return;
+		}
+
+		std::string	id=std::to_string(wp.id);
+
+		for(const auto& p : wp.problems) {
+			addFeature(problemtable, nullptr, [&](OGRFeature& feature) {
+				feature.SetField("id", id.c_str());
+				feature.SetField("layer", layer_names[p.lid]);
+				feature.SetField("problem", p.problem.c_str());
+				feature.SetField("style", p.style);
+			});
+
+			stream.write(wp, p, layer_names[p.lid]);
+		}
+	}
+
+	public:
+
+	SpatiaLiteUpdater(const std::string& dbname, ProblemStream& stream) : stream(stream) {
+		dataset=static_cast<GDALDataset *>(GDALOpenEx(dbname.c_str(), GDAL_OF_VECTOR | GDAL_OF_UPDATE,
+				nullptr, nullptr, nullptr));
+		if (!dataset)
+			throw std::runtime_error("can not open database " + dbname);
+
+		for(int i=0;i<layermax;i++) {
+			layer[i]=dataset->GetLayerByName(layer_names[i]);
+			if (!layer[i]) {
+				GDALClose(dataset);
+				throw std::runtime_error(std::string("layer ") + layer_names[i] + " missing in " + dbname);
+			}
+		}
+
+		problemways=dataset->GetLayerByName("problemways");
+		problemtable=dataset->GetLayerByName("problems");
+		waynodes=dataset->GetLayerByName("waynodes");
+
+		if (!waynodes) {
+			GDALClose(dataset);
+			throw std::runtime_error(dbname + " was not written with --updatable");
+		}
+
+		// Rows are found by way id - without an index every lookup is a full table scan
+		for(const auto& table : tables()) {
+			exec("CREATE INDEX IF NOT EXISTS \"" + table + "_id\" ON \"" + table + "\"(id)");
+		}
+
+		dataset->StartTransaction();
+
+		// The network checks need all ways - their results would go stale
+		for(int i=0;i<netlayermax;i++) {
+			if (!dataset->GetLayerByName(network_layer_names[i]))
+				continue;
+
+			std::cerr << "Warning: emptying layer " << network_layer_names[i]
+				<< " - the --network checks need a full run" << std::endl;
+			exec(std::string("DELETE FROM \"") + network_layer_names[i] + "\"");
+		}
+	}
+
+	~SpatiaLiteUpdater() {
+		GDALClose(dataset);
+	}
+
+	void commit() {
+		dataset->CommitTransaction();
+	}
+
+	// Call function(id, nodes) for every way in the waynodes table
+	template <typename TFunction>
+	void wayNodes(TFunction function) {
+		waynodes->ResetReading();
+		while (OGRFeature *feature=waynodes->GetNextFeature()) {
+			function(strtoll(feature->GetFieldAsString("id"), nullptr, 10),
+				parse_nodes(feature->GetFieldAsString("nodes")));
+			OGRFeature::DestroyFeature(feature);
+		}
+	}
+
+	// Remove all rows of these ways
+	void deleteWays(const std::vector<osmium::object_id_type>& ids) {
+		for(size_t i=0;i<ids.size();i+=500) {
+			std::string	list;
+
+			for(size_t j=i;j<ids.size() && j<i+500;j++) {
+				if (!list.empty())
+					list+=',';
+				list+="'" + std::to_string(ids[j]) + "'";
+			}
+
+			for(const auto& table : tables()) {
+				exec("DELETE FROM \"" + table + "\" WHERE id IN (" + list + ")");
+			}
+		}
+	}
+
+	// Replace the geometry in all rows of the way - Returns the number of rows
+	size_t updateGeometry(osmium::object_id_type id, const OGRLineString& linestring) {
+		std::string	filter="id = '" + std::to_string(id) + "'";
+		size_t		rows=0;
+
+		for(auto l : geometrylayers()) {
+			std::vector<GIntBig>	fids;
+
+			// Dont modify the layer while reading it
+			l->SetAttributeFilter(filter.c_str());
+			l->ResetReading();
+			while (OGRFeature *feature=l->GetNextFeature()) {
+				fids.push_back(feature->GetFID());
+				OGRFeature::DestroyFeature(feature);
+			}
+			l->SetAttributeFilter(nullptr);
+
+			for(auto fid : fids) {
+				OGRFeature *feature=l->GetFeature(fid);
+				if (!feature)
+					continue;
+
+				feature->SetGeometry(&linestring);
+				if (l->SetFeature(feature) == OGRERR_NONE)
+					rows++;
+				OGRFeature::DestroyFeature(feature);
+			}
+		}
+
+		return rows;
+	}
+
+	void writeProblems(std::vector<WayProblems> ways) {
+		for(auto& wp : ways) {
+			addFeature(waynodes, nullptr, [&](OGRFeature& feature) {
+				feature.SetField("id", std::to_string(wp.id).c_str());
+				feature.SetField("nodes", format_nodes(wp.nodes).c_str());
+			});
+
+			if (problemways) {
+				writeSharedWay(wp);
+			} else {
+				writeWay(wp);
+			}
+		}
+	}
+};
+
+/*
+ * Lookup tables - These are built once and shared by all extendedTagList
+ * instances. The key/value tables must be sorted by key (strcmp) as they
+ * are searched with a binary search.
+ */
+template <typename TValue>
+struct table_entry {
+	const char	*key;
+	TValue		value;
+};
+
+static const table_entry<int> turn_to_priority[] {
+	{ "left", 8 },
+	{ "merge_to_left", 4 },
+	{ "merge_to_right", 6 },
+	{ "none", 5 },
+	{ "reverse", 10 },
+	{ "right", 2 },
+	{ "sharp_left", 9 },
+	{ "sharp_right", 1 },
+	{ "slight_left", 7 },
+	{ "slight_right", 3 },
+	{ "through", 5 },
+};
+
+static const char * const highway_should_have_ref_list[] {
+	"motorway",
+	"trunk",
+	"primary",
+	"secondary"
+};
+
+static const char * const highway_may_have_ref_list[] {
+	"motorway",
+	"trunk",
+	"primary",
+	"secondary",
+	"tertiary"
+};
+
+static const char * const highway_motorway_list[] {
+	"motorway", "motorway_link"
+};
+
+static const char * const highway_public_list[] {
+	"motorway", "motorway_link",
+	"trunk", "trunk_link",
+	"primary", "primary_link",
+	"secondary", "secondary_link",
+	"tertiary", "tertiary_link",
+	"unclassified", "residential",
+	"living_street"
+};
+
+static const char * const highway_valid_list[] {
+	"motorway", "motorway_link",
+	"trunk", "trunk_link",
+	"primary", "primary_link",
+	"secondary", "secondary_link",
+	"tertiary", "tertiary_link",
+	"unclassified", "residential",
+	"living_street",
+	"footway", "cycleway", "path", "bridleway",
+	"service", "track",
+	"road", "pedestrian", "steps", "construction"
+};
+
+static const char * const valid_turn_types[] {
+	"left", "right", "slight_left", "slight_right",
+	"through", "merge_to_left", "merge_to_right", "reverse", "none", "sharp_left", "sharp_right", ""
+};
+
+static const char * const value_true_list[] {
+		"yes", "true", "1" };
+
+static const char * const value_false_list[] {
+		"no", "false", "0" };
+
+template <typename TValue, size_t N>
+inline const table_entry<TValue> *table_lookup(const table_entry<TValue> (&table)[N], const char *key) {
+	auto entry=std::lower_bound(std::begin(table), std::end(table), key,
+			[](const table_entry<TValue>& e, const char *k) { return std::strcmp(e.key, k) < 0; });
+
+	if (entry == std::end(table) || std::strcmp(entry->key, key) != 0)
+		return nullptr;
+
+	return entry;
+}
+
+inline bool string_in_range(const char *string, const char * const *begin, const char * const *end) {
+	if (!string)
+		return false;
+	for(auto i=begin;i!=end;i++) {
+		if (0 == std::strcmp(*i, string))
+			return true;
+	}
+	return false;
+}
+
+// Part of a tag value - not terminated so print it with %.*s
+struct ValueSpan {
+	const char	*begin;
+	size_t		len;
+
+	bool equals(const char *string) const {
+		return !std::strncmp(string, begin, len) && string[len] == '\0';
+	}
+
+	bool empty() const {
+		return len == 0;
+	}
+
+	int width() const {
+		return static_cast<int>(len);
+	}
+};
+
+template <size_t N>
+inline bool span_in_list(const ValueSpan& span, const char * const (&list)[N]) {
+	for(auto string : list) {
+		if (span.equals(string))
+			return true;
+	}
+	return false;
+}
+
+template <typename TValue, size_t N>
+inline const table_entry<TValue> *table_lookup(const table_entry<TValue> (&table)[N], const ValueSpan& key) {
+	auto entry=std::lower_bound(std::begin(table), std::end(table), key,
+			[](const table_entry<TValue>& e, const ValueSpan& k) { return std::strncmp(e.key, k.begin, k.len) < 0; });
+
+	if (entry == std::end(table) || !key.equals(entry->key))
+		return nullptr;
+
+	return entry;
+}
+
+/*
+ * Calls function for the parts of value between any of the separators until
+ * it returns false. Adjacent separators count as one, a separator at the
+ * start or the end gives an empty part.
+ */
+template <typename TFunction>
+inline void for_each_token(const char *value, const char *separators, TFunction function) {
+	while (true) {
+		size_t	len=std::strcspn(value, separators);
+
+		if (!function(ValueSpan{value, len}))
+			return;
+
+		value+=len;
+		if (!*value)
+			return;
+		value+=std::strspn(value, separators);
+	}
+}
+
+/*
+ * Numbers in tag values without exceptions or locale. The number has to be
+ * the whole value, only lengths and speeds may be followed by a unit.
+ */
+inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+inline const char *skip_spaces(const char *p) {
+	while (*p == ' ')
+		p++;
+	return p;
+}
+
+// Decimal number with optional sign and fraction - returns the end or nullptr
+inline const char *parse_decimal(const char *p, double& result) {
+	bool	negative=(*p == '-');
+	int	digits=0;
+	double	value=0;
+
+	if (*p == '-' || *p == '+')
+		p++;
+
+	for(;is_digit(*p);p++,digits++) {
+		value=value*10+(*p-'0');
+	}
+
+	if (*p == '.') {
+		double	scale=1;
+
+		for(p++;is_digit(*p);p++,digits++) {
+			scale/=10;
+			value+=(*p-'0')*scale;
+		}
+	}
+
+	if (!digits)
+		return nullptr;
+
+	result=negative ? -value : value;
+	return p;
+}
+
+inline bool parse_integer(const char *p, long& result) {
+	bool		negative=(*p == '-');
+	unsigned long	value=0;
+	unsigned long	limit=static_cast<unsigned long>(std::numeric_limits<long>::max());
+
+	if (*p == '-' || *p == '+')
+		p++;
+
+	if (!is_digit(*p))
+		return false;
+
+	for(;is_digit(*p);p++) {
+		unsigned long	digit=*p-'0';
+
+		if (value > (limit-digit)/10)
+			return false;
+		value=value*10+digit;
+	}
+
+	if (*p)
+		return false;
+
+	result=negative ? -static_cast<long>(value) : static_cast<long>(value);
+	return true;
+}
+
+// Metres - plain, with m or in feet and inches like 12'6"
+inline bool parse_length(const char *value, double& metres) {
+	double		number;
+	const char	*p=parse_decimal(value, number);
+
+	if (!p)
+		return false;
+
+	p=skip_spaces(p);
+
+	if (!*p || !strcmp(p, "m")) {
+		metres=number;
+		return true;
+	}
+
+	double	inches=0;
+
+	if (*p == '\'') {
+		p=skip_spaces(p+1);
+		if (*p) {
+			p=parse_decimal(p, inches);
+			if (!p || *p != '"' || p[1])
+				return false;
+		}
+	} else if (*p == '"' && !p[1]) {
+		inches=number;
+		number=0;
+	} else {
+		return false;
+	}
+
+	metres=number*0.3048+inches*0.0254;
+	return true;
+}
+
+// km/h - plain or with mph, knots or km/h
+inline bool parse_speed(const char *value, double& kmh) {
+	double		number;
+	const char	*p=parse_decimal(value, number);
+
+	if (!p)
+		return false;
+
+	p=skip_spaces(p);
+
+	if (!*p || !strcmp(p, "km/h")) {
+		kmh=number;
+	} else if (!strcmp(p, "mph")) {
+		kmh=number*1.609344;
+	} else if (!strcmp(p, "knots")) {
+		kmh=number*1.852;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// FNV-1a of a key - constexpr so the hashes of literal keys can be folded
+constexpr uint64_t key_hash(const char *key, uint64_t hash=14695981039346656037ULL) {
+	return *key ? key_hash(key+1, (hash ^ static_cast<unsigned char>(*key)) * 1099511628211ULL) : hash;
+}
+
+class extendedTagList  {
+	/*
+	 * Open addressing index of the tags built in one pass so every lookup
+	 * is a hash and mostly one strcmp instead of a scan over the TagList.
+	 * Ways with more tags than fit into the index fall back to the scan.
+	 */
+	struct Slot {
+		uint64_t	hash;
+		const char	*key;
+		const char	*value;
+		char		numkind;	// Parser of number - 0 if not parsed yet
+		double		number;
+	};
+
+	static const size_t		index_size=64;
+
+	const osmium::TagList&		taglist;
+	size_t				mask=0;		// Slots-1 - 0 without index
+	std::array<Slot, index_size>	index;
+
+	const Slot *find(const char *key) const {
+		uint64_t	hash=key_hash(key);
+
+		for(size_t pos=hash & mask;index[pos].key;pos=(pos+1) & mask) {
+			if (index[pos].hash == hash && !strcmp(index[pos].key, key))
+				return &index[pos];
+		}
+		return nullptr;
+	}
+
+	const char *lookup(const char *key) const {
+		if (!mask)
+			return taglist.get_value_by_key(key);
+
+		const Slot	*slot=find(key);
+		return slot ? slot->value : nullptr;
+	}
+
+	// The value of key as number, parsed once per way and kind - NaN if missing or broken
+	template <typename TParser>
+	double number(const char *key, char kind, TParser parser) {
+		Slot		*slot=mask ? const_cast<Slot *>(find(key)) : nullptr;
+		const char	*value=mask ? (slot ? slot->value : nullptr) : taglist.get_value_by_key(key);
+
+		if (slot && slot->numkind == kind)
+			return slot->number;
+
+		double	result=std::numeric_limits<double>::quiet_NaN();
+		if (value && !parser(value, result))
+			result=std::numeric_limits<double>::quiet_NaN();
+
+		if (slot) {
+			slot->numkind=kind;
+			slot->number=result;
+		}
+		return result;
+	}
+
+	public:
+		extendedTagList(const osmium::TagList& tags) : taglist(tags) {
+			size_t	size=8;
+
+			while (size < tags.size()*2)
+				size<<=1;
+
+			if (size > index_size)
+				return;
+
+			for(size_t i=0;i<size;i++) {
+				index[i].key=nullptr;
+			}
+			mask=size-1;
+
+			// Duplicate keys - the first tag comes first in the probe sequence
+			for(const auto& tag : tags) {
+				uint64_t	hash=key_hash(tag.key());
+				size_t		pos=hash & mask;
+
+				while (index[pos].key)
+					pos=(pos+1) & mask;
+
+				index[pos].hash=hash;
+				index[pos].key=tag.key();
+				index[pos].value=tag.value();
+				index[pos].numkind=0;
+			}
+		}
+
+		const char* operator[](const char* key) const noexcept {
+			return lookup(key);
+		}
+
+		template <size_t N>
+		bool string_in_list(const char *string, const char * const (&list)[N]) {
+			return string_in_range(string, std::begin(list), std::end(list));
+		}
+
+		bool key_value_in_list(const char *key, std::initializer_list<const char *> list) {
+			return string_in_range(get_value_by_key(key), list.begin(), list.end());
+		}
+
+		// Metres
+		double key_value_as_length(const char *key) {
+			return number(key, 'l', parse_length);
+		}
+
+		// km/h
+		double key_value_as_speed(const char *key) {
+			return number(key, 's', parse_speed);
+		}
+
+		int key_value_as_int(const char *key) {
+			double result=number(key, 'i', [](const char *value, double& result) {
+				long	integer;
+
+				if (!parse_integer(value, integer)
+						|| integer >= std::numeric_limits<int>::max()
+						|| integer < std::numeric_limits<int>::min())
+					return false;
+
+				result=integer;
+				return true;
+			});
+
+			return std::isnan(result) ? std::numeric_limits<int>::max() : static_cast<int>(result);
+		}
+
+		bool key_value_is_int(const char *key) {
+			return key_value_as_int(key) != std::numeric_limits<int>::max();
+		}
+
+		bool highway_should_have_ref() {
+			return string_in_list(get_value_by_key("highway"), highway_should_have_ref_list);
+		}
+
+		bool highway_may_have_ref() {
+			return string_in_list(get_value_by_key("highway"), highway_may_have_ref_list);
+		}
+
+		const char *get_value_by_key(const char *key) {
+			return lookup(key);
+		}
+
+		bool has_key(const char *key) {
+			return lookup(key) != nullptr;
+		}
+
+		bool has_key_value(const char *key, const char *value) {
+			const char	*tlvalue=lookup(key);
+			if (!tlvalue)
+				return 0;
+			return (0 == strcmp(tlvalue, value));
+		}
+
+		bool key_value_is_true(const char *key) {
+			return string_in_list(get_value_by_key(key), value_true_list);
+		}
+
+		bool key_value_is_false(const char *key) {
+			return string_in_list(get_value_by_key(key), value_false_list);
+		}
+
+		bool road_is_public() {
+			return string_in_list(get_value_by_key("highway"), highway_public_list);
+		}
+
+		bool road_is_motorway() {
+			return string_in_list(get_value_by_key("highway"), highway_motorway_list);
+		}
+
+		bool is_bridge() {
+			return key_value_in_list("bridge", { "yes", "true", "1" });
+		}
+
+		bool is_tunnel() {
+			return key_value_in_list("tunnel", { "yes", "true", "1", "avalanche_protector", "building_passage" });
+		}
+
+		int turn_command_priority(const ValueSpan& turn) {
+			auto prioritypair=table_lookup(turn_to_priority, turn);
+
+			if (!prioritypair)
+				return 0;
+
+			return prioritypair->value;
+		}
+};
+
+
+/*
+ * Rules which only compare one tag against values or numbers. They are read
+ * from the file given with --rules, default_rules below is used otherwise.
+ * One rule per line, # starts a comment:
+ *
+ * values <key> <layer> <style> <v1,v2,..> <message>  - value is not in the list
+ * match <key> <layer> <style> <v1,v2,..> <message>   - value is in the list
+ * integer <key> <layer> <style> <message>            - value is not an integer
+ * min <key> <layer> <style> <number> <message>       - integer value below number
+ * max <key> <layer> <style> <number> <message>       - integer value above number
+ * equal <key> <layer> <style> <number> <message>     - integer value equal to number e.g. 00 or -0 for 0
+ * maxspeed <maxspeed:type> <maxspeed>                - maxspeed implied by the type
+ *
+ * The message may contain one %s for the value. The layer is the table name.
+ */
+static const char default_rules[]=R"(# Known values
+values tracktype wayproblems brownline grade1,grade2,grade3,grade4,grade5 tracktype=%s is unknown
+values construction wayproblems default yes,no,widening,minor,motorway,motorway_link,trunk,trunk_link,primary,primary_link,secondary,secondary_link,tertiary,tertiary_link,unclassified,residential,pedestrian,service,track,cycleway,footway,steps,path construction=%s not in known list
+values cutting wayproblems default no,yes,1,0,true,false,left,right cutting=%s is not in known value list
+values embankment wayproblems default no,yes,1,0,true,false embankment=%s is not in known value list
+values lit wayproblems default no,yes,limited,24/7,automatic lit=%s is not in known value list
+values hazmat wayproblems default no,yes,destination,designated hazmat=%s is not in known value list
+values maxspeed:type wayproblems steelline sign,signals,DE:motorway,DE:urban,DE:rural,DE:zone,DE:bicycle_road,DE:zone30,DE:zone:30,DE:zone20,DE:zone:20,DE:zone10,DE:zone:10 maxspeed:type=%s is unknown
+values source:maxspeed wayproblems steelline sign,signals,DE:motorway,DE:urban,DE:rural,DE:zone,DE:bicycle_road,DE:zone30,DE:zone:30,DE:zone20,DE:zone:20,DE:zone10,DE:zone:10 source:maxspeed=%s is unknown
+
+# Defaults and deprecated values
+match tunnel defaults redundant no,false,0 tunnel=no ist default
+match construction wayproblems redundant yes construction=yes is deprecated
+match construction defaults redundant no construction=no is default
+match cutting defaults default no,0,false cutting=no is default
+match embankment defaults default no,0,false embankment=no is default
+equal layer defaults redundant 0 layer=%s is default
+
+# Thresholds
+integer layer wayproblems default layer=%s is not integer
+max layer wayproblems redundant 10 layer=%s where num > 10 seems broken
+min layer wayproblems redundant -10 layer=%s where num < -10 seems broken
+
+# Implied maxspeed of maxspeed:type and source:maxspeed
+maxspeed DE:bicycle_road 30
+maxspeed DE:rural 100
+maxspeed DE:urban 50
+maxspeed DE:zone10 10
+maxspeed DE:zone20 20
+maxspeed DE:zone30 30
+maxspeed DE:zone:10 10
+maxspeed DE:zone:20 20
+maxspeed DE:zone:30 30
+)";
+
+class RuleSet {
+	enum rule_kind {
+		R_VALUES,
+		R_MATCH,
+		R_INTEGER,
+		R_MIN,
+		R_MAX,
+		R_EQUAL
+	};
+
+	struct Rule {
+		size_t				key;
+		rule_kind			kind;
+		layerid				lid;
+		std::string			style;
+		std::string			message;
+		std::vector<std::string>	values;
+		long				limit;
+	};
+
+	// Slot of the dispatch table - the rules of a key are rules[first..first+count)
+	struct Slot {
+		bool		used=false;
+		uint64_t	hash=0;
+		size_t		key=0;
+		size_t		first=0;
+		size_t		count=0;
+	};
+
+	std::string					source;
+	std::vector<std::string>			keys;
+	std::vector<Rule>				rules;
+	std::vector<Slot>				table;
+	std::vector<std::pair<std::string, std::string>>	maxspeeds;
+
+	static bool value_in(const char *value, const std::vector<std::string>& values) {
+		for(const auto& v : values) {
+			if (v == value)
+				return true;
+		}
+		return false;
+	}
+
+	// At most one %s as the only argument is the value
+	static bool valid_message(const std::string& message) {
+		int	args=0;
+
+		for(size_t i=0;i<message.size();i++) {
+			if (message[i] != '%')
+				continue;
+			if (i+1 < message.size() && message[i+1] == '%') {
+				i++;
+				continue;
+			}
+			if (i+1 >= message.size() || message[i+1] != 's' || ++args > 1)
+				return false;
+		}
+		return true;
+	}
+
+	void parse(const std::string& text) {
+		std::istringstream	in(text);
+		std::string		line;
+		int			lineno=0;
+
+		while (std::getline(in, line)) {
+			lineno++;
+
+			std::istringstream	fields(line);
+			std::string		kind;
+
+			if (!(fields >> kind) || kind[0] == '#')
+				continue;
+
+			auto error=[&](const std::string& what) {
+				return std::runtime_error("rules line " + std::to_string(lineno) + ": " + what);
+			};
+
+			if (kind == "maxspeed") {
+				std::string	type, speed;
+				if (!(fields >> type >> speed))
+					throw error("maxspeed needs type and speed");
+				maxspeeds.emplace_back(type, speed);
+				continue;
+			}
+
+			Rule		rule;
+			std::string	key, layer, values;
+
+			if (kind == "values") {
+				rule.kind=R_VALUES;
+			} else if (kind == "match") {
+				rule.kind=R_MATCH;
+			} else if (kind == "integer") {
+				rule.kind=R_INTEGER;
+			} else if (kind == "min") {
+				rule.kind=R_MIN;
+			} else if (kind == "max") {
+				rule.kind=R_MAX;
+			} else if (kind == "equal") {
+				rule.kind=R_EQUAL;
+			} else {
+				throw error("unknown rule " + kind);
+			}
+
+			if (!(fields >> key >> layer >> rule.style))
+				throw error("missing key, layer or style");
+
+			auto name=std::find_if(std::begin(layer_names), std::end(layer_names),
+				[&](const char *n) { return layer == n; });
+			if (name == std::end(layer_names))
+				throw error("unknown layer " + layer);
+			rule.lid=static_cast<layerid>(name-std::begin(layer_names));
+
+			if (rule.kind == R_VALUES || rule.kind == R_MATCH) {
+				if (!(fields >> values))
+					throw error("missing values");
+				boost::split(rule.values, values, boost::is_any_of(","));
+			} else if (rule.kind == R_MIN || rule.kind == R_MAX || rule.kind == R_EQUAL) {
+				std::string	limit;
+				if (!(fields >> limit) || !parse_integer(limit.c_str(), rule.limit))
+					throw error("missing or broken number");
+			}
+
+			std::getline(fields >> std::ws, rule.message);
+			if (rule.message.empty())
+				throw error("missing message");
+			if (!valid_message(rule.message))
+				throw error("message may only contain one %s");
+
+			auto it=std::find(keys.begin(), keys.end(), key);
+			rule.key=it-keys.begin();
+			if (it == keys.end())
+				keys.push_back(key);
+
+			rules.push_back(std::move(rule));
+		}
+	}
+
+	// Group the rules by key and build the open addressing table
+	void compile() {
+		std::stable_sort(rules.begin(), rules.end(),
+			[](const Rule& a, const Rule& b) { return a.key < b.key; });
+
+		size_t	size=4;
+		while (size < keys.size()*2)
+			size<<=1;
+		table.assign(size, Slot());
+
+		for(size_t i=0;i<rules.size();) {
+			size_t	first=i;
+			while (i < rules.size() && rules[i].key == rules[first].key)
+				i++;
+
+			uint64_t	hash=key_hash(keys[rules[first].key].c_str());
+			size_t		pos=hash & (table.size()-1);
+
+			while (table[pos].used)
+				pos=(pos+1) & (table.size()-1);
+
+			table[pos].used=true;
+			table[pos].key=rules[first].key;
+			table[pos].hash=hash;
+			table[pos].first=first;
+			table[pos].count=i-first;
+		}
+
+		std::sort(maxspeeds.begin(), maxspeeds.end());
+	}
+
+	const Slot *find(const char *key) const {
+		uint64_t	hash=key_hash(key);
+		size_t		pos=hash & (table.size()-1);
+
+		for(;table[pos].used;pos=(pos+1) & (table.size()-1)) {
+			if (table[pos].hash == hash && keys[table[pos].key] == key)
+				return &table[pos];
+		}
+		return nullptr;
+	}
+
+	public:
+		explicit RuleSet(const std::string& text) : source(text) {
+			parse(text);
+			compile();
+		}
+
+		// The problems point to the styles of the rules
+		RuleSet(const RuleSet&)=delete;
+		RuleSet(RuleSet&&)=default;
+
+		static RuleSet from_file(const std::string& filename) {
+			std::ifstream		in(filename);
+			std::stringstream	text;
+
+			if (!in)
+				throw std::runtime_error("can not read rules " + filename);
+
+			text << in.rdbuf();
+			return RuleSet(text.str());
+		}
+
+		static const RuleSet& defaults() {
+			static const RuleSet	rules(default_rules);
+			return rules;
+		}
+
+		const std::string& text() const {
+			return source;
+		}
+
+		bool has_key(const char *key) const {
+			return find(key) != nullptr;
+		}
+
+		const char *maxspeed_for_type(const char *type) const {
+			if (!type)
+				return nullptr;
+
+			auto it=std::lower_bound(maxspeeds.begin(), maxspeeds.end(), type,
+				[](const std::pair<std::string, std::string>& e, const char *t) { return e.first < t; });
+
+			if (it == maxspeeds.end() || it->first != type)
+				return nullptr;
+			return it->second.c_str();
+		}
+
+		// One pass over the tags - only the rules of present keys run
+		void check(const osmium::Way& way, ProblemCollector& writer) const {
+			for(const auto& tag : way.tags()) {
+				const Slot	*slot=find(tag.key());
+
+				if (!slot)
+					continue;
+
+				for(size_t i=slot->first;i<slot->first+slot->count;i++) {
+					const Rule&	rule=rules[i];
+					const char	*value=tag.value();
+					long		number;
+					bool		problem=false;
+
+					switch(rule.kind) {
+						case R_VALUES:
+							problem=!value_in(value, rule.values);
+							break;
+						case R_MATCH:
+							problem=value_in(value, rule.values);
+							break;
+						case R_INTEGER:
+							problem=!parse_integer(value, number);
+							break;
+						case R_MIN:
+							problem=parse_integer(value, number) && number < rule.limit;
+							break;
+						case R_MAX:
+							problem=parse_integer(value, number) && number > rule.limit;
+							break;
+						case R_EQUAL:
+							problem=parse_integer(value, number) && number == rule.limit;
+							break;
+					}
+
+					if (problem)
+						writer.writeWay(rule.lid, way, rule.style.c_str(), rule.message.c_str(), value);
+				}
+			}
+		}
+};
+
+/*
+ * Keys no check reads - they are left out of the tag set memo unless a
+ * rule reads them. Keys starting with one of the prefixes are left out
+ * as well.
+ */
+static const char * const memo_ignored_keys[] {
+	"FIXME", "alt_name", "check_date", "created_by", "description", "fixme",
+	"loc_name", "mapillary", "note", "official_name", "old_name", "old_ref",
+	"source", "source:geometry", "start_date", "survey:date", "wikidata", "wikipedia"
+};
+
+static const char * const memo_ignored_prefixes[] {
+	"name:", "old_name:", "alt_name:", "official_name:"
+};
+
+/*
+ * Memo of the checks which only look at the tags. Lots of ways share the
+ * same tags, residential roads often only differ by name. The problems are
+ * stored by the canonical tag list - sorted by key and without the keys
+ * no check reads. For name only its presence matters. The table is direct
+ * mapped so its size is bounded - a tag set replaces the one it collides with.
+ */
+class TagSetMemo {
+	struct Entry {
+		bool			used=false;
+		std::string		tags;
+		std::vector<Problem>	problems;
+	};
+
+	std::vector<Entry>					table;
+	std::vector<std::pair<const char *, const char *>>	sorted;
+	std::string						canonical;
+	uint64_t						hash=0;
+	const RuleSet						&rules;
+
+	bool ignored(const char *key) const {
+		if (rules.has_key(key))
+			return false;
+
+		if (string_in_range(key, std::begin(memo_ignored_keys), std::end(memo_ignored_keys)))
+			return true;
+
+		for(auto prefix : memo_ignored_prefixes) {
+			if (!strncmp(key, prefix, strlen(prefix)))
+				return true;
+		}
+		return false;
+	}
+
+	public:
+		// Size is rounded up to a power of two - 0 disables the memo
+		TagSetMemo(size_t size, const RuleSet& rules) : rules(rules) {
+			size_t	n=1;
+
+			while (n < size)
+				n<<=1;
+			if (size)
+				table.resize(n);
+		}
+
+		bool enabled() const {
+			return !table.empty();
+		}
+
+		// The problems of the tag set or nullptr - remembers the tags for store()
+		const std::vector<Problem> *find(const osmium::TagList& tags) {
+			sorted.clear();
+			for(const auto& tag : tags) {
+				if (ignored(tag.key()))
+					continue;
+				sorted.emplace_back(tag.key(), strcmp(tag.key(), "name") ? tag.value() : "");
+			}
+
+			std::sort(sorted.begin(), sorted.end(),
+				[](const std::pair<const char *, const char *>& a, const std::pair<const char *, const char *>& b) {
+					return strcmp(a.first, b.first) < 0;
+				});
+
+			canonical.clear();
+			for(const auto& kv : sorted) {
+				canonical.append(kv.first);
+				canonical.push_back('\0');
+				canonical.append(kv.second);
+				canonical.push_back('\0');
+			}
+
+			hash=14695981039346656037ULL;
+			for(unsigned char c : canonical) {
+				hash=(hash ^ c) * 1099511628211ULL;
+			}
+
+			// Hashes collide - only the full tag list is a hit
+			const Entry&	entry=table[hash & (table.size()-1)];
+			if (entry.used && entry.tags == canonical)
+				return &entry.problems;
+
+			return nullptr;
+		}
+
+		// Store the problems the collector got since first for the tags of the last find()
+		void store(const ProblemCollector& collector, size_t first) {
+			Entry&	entry=table[hash & (table.size()-1)];
+
+			entry.used=true;
+			entry.tags=canonical;
+			entry.problems.clear();
+			for(size_t i=first;i<collector.pending();i++) {
+				entry.problems.push_back(collector.pending_problem(i));
+			}
+		}
+};
+
+/*
+ * Counters for --stats. Every WayHandler counts into its own CheckStats,
+ * the ones of the check threads are merged at the end. The checks are
+ * indexed like WayHandler::checks().
+ */
+struct CheckCounter {
+	uint64_t			calls=0;
+	uint64_t			problems=0;
+	std::chrono::nanoseconds	time{0};
+};
+
+struct CheckStats {
+	std::vector<CheckCounter>	checks;
+	std::array<uint64_t, layermax>	layers{};
+
+	// Ways which took their problems from the tag set memo
+	uint64_t			memo_hits=0;
+	uint64_t			memo_misses=0;
+
+	void merge(const CheckStats& other) {
+		if (checks.size() < other.checks.size())
+			checks.resize(other.checks.size());
+
+		for(size_t i=0;i<other.checks.size();i++) {
+			checks[i].calls+=other.checks[i].calls;
+			checks[i].problems+=other.checks[i].problems;
+			checks[i].time+=other.checks[i].time;
+		}
+		for(size_t i=0;i<layers.size();i++) {
+			layers[i]+=other.layers[i];
+		}
+		memo_hits+=other.memo_hits;
+		memo_misses+=other.memo_misses;
+	}
+};
+
+/*
+ * Maps the keys the checks read to the mask of checks reading them. One
+ * pass over the tags of a way gives the checks which need to run. Checks
+ * without keys look at highway or the nodes and are always in the mask.
+ */
+using check_mask = uint64_t;
+
+class CheckDispatch {
+	struct Slot {
+		bool		used=false;
+		uint64_t	hash=0;
+		size_t		key=0;
+		check_mask	checks=0;
+	};
+
+	std::vector<std::string>	keys;
+	std::vector<Slot>		table;
+	check_mask			always=0;
+
+
+	Slot& slot(const std::string& key) {
+		uint64_t	hash=key_hash(key.c_str());
+		size_t		pos=hash & (table.size()-1);
+
+		for(;table[pos].used;pos=(pos+1) & (table.size()-1)) {
+			if (table[pos].hash == hash && keys[table[pos].key] == key)
+				return table[pos];
+		}
+
+		table[pos].used=true;
+		table[pos].hash=hash;
+		table[pos].key=keys.size();
+		keys.push_back(key);
+		return table[pos];
+	}
+
+	public:
+		// The space separated key list of each check
+		explicit CheckDispatch(const std::vector<const char *>& checkkeys) {
+			if (checkkeys.size() > 64)
+				throw std::runtime_error("more than 64 checks");
+
+			std::vector<std::vector<std::string>>	split(checkkeys.size());
+			size_t					count=0;
+
+			for(size_t i=0;i<checkkeys.size();i++) {
+				boost::split(split[i], checkkeys[i], boost::is_any_of(" "), boost::token_compress_on);
+				split[i].erase(std::remove(split[i].begin(), split[i].end(), ""), split[i].end());
+				count+=split[i].size();
+			}
+
+			size_t	size=4;
+			while (size < count*2)
+				size<<=1;
+			table.assign(size, Slot());
+
+			for(size_t i=0;i<split.size();i++) {
+				if (split[i].empty())
+					always|=check_mask(1) << i;
+
+				for(const auto& key : split[i]) {
+					slot(key).checks|=check_mask(1) << i;
+				}
+			}
+		}
+
+		check_mask checks(const osmium::TagList& tags) const {
+			check_mask	result=always;
+
+			for(const auto& tag : tags) {
+				uint64_t	hash=key_hash(tag.key());
+				size_t		pos=hash & (table.size()-1);
+
+				for(;table[pos].used;pos=(pos+1) & (table.size()-1)) {
+					if (table[pos].hash == hash && keys[table[pos].key] == tag.key()) {
+						result|=table[pos].checks;
+						break;
+					}
+				}
+			}
+			return result;
+		}
+};
+
+// How the WayHandlers of a run are set up
+struct CheckOptions {
+	bool		stats;		// Count and time the checks
+	bool		keepnodes;	// Keep the node ids for --updatable
+	ResultCache	*cache;
+	size_t		memosize;	// Tag set memo entries per handler
+	const RuleSet	*rules;		// nullptr uses the default rules
+	check_mask	skip;		// Checks disabled by --checks/--skip-checks
+};
+
+/*
+ * Monotonic arena for the temporaries of the checks on one way. The blocks
+ * are kept when the arena is reset for the next way so after the first ways
+ * the checks do not allocate any more.
+ */
+class WayArena {
+	static const size_t	block_size=4096;
+
+	struct Block {
+		std::unique_ptr<char[]>	data;
+		size_t			size;
+	};
+
+	std::vector<Block>	blocks;
+	size_t			block=0;	// Block currently handed out from
+	size_t			used=0;		// Bytes used of that block
+
+	public:
+		void *allocate(size_t size, size_t align=alignof(std::max_align_t)) {
+			while (true) {
+				if (block < blocks.size()) {
+					size_t	start=(used+align-1) & ~(align-1);
+
+					if (start+size <= blocks[block].size) {
+						used=start+size;
+						return blocks[block].data.get()+start;
+					}
+					block++;
+					used=0;
+					continue;
+				}
+
+				size_t	bsize=size+align > block_size ? size+align : block_size;
+				blocks.push_back(Block{std::unique_ptr<char[]>(new char[bsize]), bsize});
+			}
+		}
+
+		template <typename T>
+		T *array(size_t count) {
+			return static_cast<T *>(allocate(sizeof(T)*count, alignof(T)));
+		}
+
+		// All memory handed out so far may be reused
+		void reset() {
+			block=0;
+			used=0;
+		}
+};
+
+// The lane counts with the keys holding one value per lane
+struct LaneKeys {
+	const char	*key;
+	const char	*turn;
+	const char	*destination;
+	const char	*change;
+	const char	*width;
+};
+
+static const LaneKeys lane_keys[] {
+	{ "lanes", "turn:lanes", "destination:lanes", "change:lanes", "width:lanes" },
+	{ "lanes:forward", "turn:lanes:forward", "destination:lanes:forward", "change:lanes:forward", "width:lanes:forward" },
+	{ "lanes:backward", "turn:lanes:backward", "destination:lanes:backward", "change:lanes:backward", "width:lanes:backward" },
+};
+
+static const char * const valid_change_types[] {
+	"yes", "no", "not_left", "not_right", "only_left", "only_right"
+};
+
+/*
+ * A *:lanes value split at | into the values of the lanes. The spans point
+ * into the tag value, only the span array lives in the arena.
+ */
+struct LaneValues {
+	const char	*key=nullptr;
+	const char	*value=nullptr;
+	ValueSpan	*lanes=nullptr;
+	size_t		count=0;
+
+	void parse(const char *lanekey, const char *lanevalue, WayArena& arena) {
+		key=lanekey;
+		value=lanevalue;
+		count=0;
+
+		if (!value)
+			return;
+
+		count=1;
+		for(const char *p=value;*p;p++) {
+			if (*p == '|')
+				count++;
+		}
+
+		lanes=arena.array<ValueSpan>(count);
+
+		const char	*begin=value;
+		for(size_t i=0;i<count;i++) {
+			const char	*end=strchr(begin, '|');
+			size_t		len=end ? end-begin : strlen(begin);
+
+			lanes[i]=ValueSpan{begin, len};
+			begin+=len+1;
+		}
+	}
+
+	const ValueSpan *begin() const { return lanes; }
+	const ValueSpan *end() const { return lanes+count; }
+};
+
+class WayHandler : public osmium::handler::Handler {
+	ProblemCollector	&writer;
+	CheckStats		*stats;
+	ResultCache::Builder	*cache;
+	const RuleSet		&rules;
+	TagSetMemo		memo;
+	check_mask		enabled;
+	WayArena		arena;
+
+	// The *:lanes values parsed on the current way
+	std::array<LaneValues, 16>	lanevalues;
+	size_t				lanevaluecount=0;
+
+	// Parsed once per way for all lane checks - nullptr if the way does not have the key
+	const LaneValues *lane_values(extendedTagList& taglist, const char *key) {
+		for(size_t i=0;i<lanevaluecount;i++) {
+			if (lanevalues[i].key == key || !strcmp(lanevalues[i].key, key))
+				return lanevalues[i].value ? &lanevalues[i] : nullptr;
+		}
+
+		LaneValues&	result=lanevalues[lanevaluecount < lanevalues.size() ? lanevaluecount++ : lanevalues.size()-1];
+
+		result.parse(key, taglist[key], arena);
+		return result.value ? &result : nullptr;
+	}
+
+	public:
+		WayHandler(ProblemCollector &writer, CheckStats *stats=nullptr, const CheckOptions& options=CheckOptions{}) :
+				writer(writer), stats(stats),
+				cache(options.cache ? &options.cache->builder() : nullptr),
+				rules(options.rules ? *options.rules : RuleSet::defaults()),
+				memo(options.memosize, rules),
+				enabled(all_checks() & ~options.skip) {
+			if (stats)
+				stats->checks.resize(checks().size());
+		};
+
+		void circular_way(osmium::Way& way, extendedTagList& taglist) {
+			if (way.ends_have_same_id()) {
+				if (!taglist.has_key_value("area", "yes")
+					&& !taglist.has_key_value("junction", "roundabout")
+					&& taglist.key_value_in_list("highway", { "tertiary", "secondary",
+						"primary", "unclassified", "residential" })) {
+					writer.writeWay(L_STRANGE, way, "default", "Circular way without junction=roundabout");
+				}
+			} else {
+				if (taglist.has_key_value("area", "yes")) {
+					writer.writeWay(L_WP, way, "default", "area=yes on unclosed way");
+				}
+			}
+		}
+
+		// The value list, default and threshold rules
+		void tag_rules(osmium::Way& way, extendedTagList&) {
+			rules.check(way, writer);
+		}
+
+		void tag_ref(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.highway_should_have_ref()) {
+				if (!taglist.has_key_value("junction", "roundabout")) {
+					if (!taglist.has_key("ref")) {
+						writer.writeWay(L_REF, way, "ref", "highway should have ref");
+					}
+				}
+			}
+
+			if (!taglist.highway_may_have_ref()) {
+				if (!taglist.has_key_value("highway", "path")) {
+					if (taglist.has_key("ref")) {
+						writer.writeWay(L_REF, way, "ref", "highway should not have ref");
+					}
+				}
+			}
+
+			if (taglist.key_value_in_list("ref", { "-", "+", "*", ".", "_", " ", "\t", "#" })) {
+				writer.writeWay(L_REF, way, "ref", "ref=%s seems broken", taglist.get_value_by_key("ref"));
+				writer.writeWay(L_WP, way, "ref", "ref=%s seems broken", taglist.get_value_by_key("ref"));
+			}
+		}
+
+		void tag_maxspeed_source(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("maxspeed:source"))
+				return;
+
+			writer.writeWay(L_WP, way, "steelline", "maxspeed:source should be source:maxspeed or maxspeed:type");
+		}
+
+		void tag_maxspeed_type(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("maxspeed:type"))
+				return;
+
+			maxspeed_check_against_type(way, taglist, "maxspeed:type");
+		}
+
+		void tag_zone_traffic(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("zone:traffic"))
+				return;
+
+			if (!taglist.key_value_in_list("zone:traffic", { "DE:urban", "DE:rural", "DE:motorway" })) {
+				writer.writeWay(L_WP, way, "steelline", "zone:traffic=%s is unknown",
+					taglist.get_value_by_key("zone:traffic"));
+			}
+		}
+
+		void tag_source_maxspeed(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("source:maxspeed"))
+				return;
+
+			maxspeed_check_against_type(way, taglist, "source:maxspeed");
+		}
+
+		void maxspeed_check_against_type(osmium::Way& way, extendedTagList& taglist, const char *origin) {
+			auto maxspeedfromtype=rules.maxspeed_for_type(taglist.get_value_by_key(origin));
+
+			if (maxspeedfromtype == nullptr)
+				return;
+
+			if (taglist.has_key("maxspeed")) {
+				auto maxspeed=taglist.get_value_by_key("maxspeed");
+				if (0 != std::strcmp(maxspeed, maxspeedfromtype)) {
+					writer.writeWay(L_WP, way, "steelline", "%s=%s is %s but maxspeed contains %s",
+						origin,
+						taglist.get_value_by_key(origin),
+						maxspeedfromtype,
+						maxspeed);
+
+					// std::cerr << "Mismatch " << maxspeed << " from type " << maxspeedfromtype << std::endl;
+				}
+
+
+			} else {
+				writer.writeWay(L_WP, way, "steelline", "%s=%s is %s but no maxspeed",
+					origin, taglist.get_value_by_key(origin),
+					maxspeedfromtype);
+
+				// std::cerr << "No maxspeed - from type " << maxspeedfromtype << std::endl;
+			}
+		}
+
+		void tag_maxspeed(osmium::Way& way, extendedTagList& taglist) {
+			/*
+			 * Maxspeed
+			 *
+			 */
+
+			// maxspeed, maxspeed:forward and maxspeed:backward for all vehicles
+			static const char * const	maxspeedtags[]={
+				"maxspeed", "maxspeed:hgv", "maxspeed:vehicle", "maxspeed:motor_vehicle", "maxspeed:bus",
+				"maxspeed:forward", "maxspeed:forward:hgv", "maxspeed:forward:vehicle",
+				"maxspeed:forward:motor_vehicle", "maxspeed:forward:bus",
+				"maxspeed:backward", "maxspeed:backward:hgv", "maxspeed:backward:vehicle",
+				"maxspeed:backward:motor_vehicle", "maxspeed:backward:bus" };
+
+			for(auto key : maxspeedtags) {
+				if (!taglist.has_key(key))
+					continue;
+
+				if (taglist.key_value_in_list(key, { "none", "signals" }))
+					continue;
+
+				if (std::isnan(taglist.key_value_as_speed(key))) {
+					writer.writeWay(L_WP, way, "steelline", "%s=%s is not numerical",
+							key, taglist[key]);
+				}
+				// TODO - > 120?
+			}
+
+			if (taglist.has_key("maxspeed") && (
+					 taglist.has_key("maxspeed:forward")
+					 || taglist.has_key("maxspeed:backward")
+					)) {
+				writer.writeWay(L_WP, way, "steelline", "maxspeed and maxspeed:forward/backward - overlapping values");
+			}
+		}
+
+		void tag_maxheight(osmium::Way& way, extendedTagList& taglist) {
+			/*
+			 * Maxheight
+			 */
+			if (!taglist.has_key("maxheight"))
+				return;
+
+			if (taglist.key_value_in_list("maxheight", { "default", "none", "unsigned", "no_sign", "no_indications", "below_default" }))
+				return;
+
+			double maxheight=taglist.key_value_as_length("maxheight");
+
+			if (std::isnan(maxheight)) {
+				writer.writeWay(L_WP, way, "default", "maxheight=%s is not float",
+					taglist["maxheight"]);
+			} else {
+				if (maxheight < 1.8) {
+					// https://www.openstreetmap.org/way/25048948
+					writer.writeWay(L_WP, way, "default", "maxheight=%s is less than 1.8",
+						taglist["maxheight"]);
+					// TODO - Maxheight for general traffic - parking access might be lower
+				} else if (maxheight > 7) {
+					// https://www.openstreetmap.org/way/25363727
+					writer.writeWay(L_WP, way, "default", "maxheight=%s is more than 7 - suspicous value",
+						taglist["maxheight"]);
+				}
+			}
+		}
+
+		void tag_type(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("type"))
+				return;
+
+			if (taglist.has_key_value("type", "route")) {
+				writer.writeWay(L_WP, way, "default", "type=%s is defined for route relations not ways",
+					taglist["type"]);
+			} else {
+				writer.writeWay(L_STRANGE, way, "default", "type=%s is strange",
+					taglist["type"]);
+			}
+		}
+
+
+		void tag_maxwidth(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("maxwidth"))
+				return;
+
+			double maxwidth=taglist.key_value_as_length("maxwidth");
+
+			if (std::isnan(maxwidth)) {
+				writer.writeWay(L_WP, way, "default", "maxwidth=%s is not float",
+					taglist["maxwidth"]);
+			} else {
+				if (maxwidth < 1.8) {
+					writer.writeWay(L_WP, way, "default", "maxwidth=%s is less than 1.8",
+						taglist["maxwidth"]);
+				} else if (maxwidth > 7) {
+					writer.writeWay(L_WP, way, "default", "maxwidth=%s is more than 7 - suspicous value",
+						taglist["maxwidth"]);
+				}
+			}
+		}
+
+		void tag_lanes(osmium::Way& way, extendedTagList& taglist) {
+			/*
+			 * Lanes
+			 *
+			 */
+			for(const auto& lanetag : lane_keys) {
+				const char	*key=lanetag.key;
+
+				if (!taglist.has_key(key))
+					continue;
+
+				if (!taglist.key_value_is_int(key)) {
+					writer.writeWay(L_WP, way, "default", "%s=%s is not integer",
+							key, taglist.get_value_by_key(key));
+				} else {
+					int lanes=taglist.key_value_as_int(key);
+
+					if (lanes<=0) {
+						writer.writeWay(L_WP, way, "default", "%s=%s is less or equal 0",
+								key, taglist.get_value_by_key(key));
+					} else if (lanes > 8) {
+						writer.writeWay(L_WP, way, "default", "%s=%s is more than 8 - suspicious value",
+								key, taglist.get_value_by_key(key));
+					}
+				}
+
+				// TODO - if there is only lanes + lanes:forward we calculate lanes:backward and vice versa
+
+				for(auto lanekey : { lanetag.turn, lanetag.destination, lanetag.change, lanetag.width }) {
+					const LaneValues	*lanevalues=lane_values(taglist, lanekey);
+
+					if (lanevalues) {
+						int lanes=taglist.key_value_as_int(key);
+						if (lanes != static_cast<int>(lanevalues->count)) {
+							writer.writeWay(L_WP, way, "default", "%s=%d does not match elements in %s=%s",
+									key, lanes, lanekey, lanevalues->value);
+						}
+					}
+				}
+
+				const char	*turnkey=lanetag.turn;
+				const char	*turnlanes=taglist.get_value_by_key(turnkey);
+
+				if (turnlanes) {
+					for_each_token(turnlanes, "|;", [&](const ValueSpan& turntype) {
+						if (!span_in_list(turntype, valid_turn_types)) {
+							writer.writeWay(L_WP, way, "default", "%s=%s contains lane turn %.*s which is unknown",
+									key, turnlanes, turntype.width(), turntype.begin);
+						}
+						return true;
+					});
+
+					// For order by turn commands - its left to right
+					int prioritylast=99999;
+					ValueSpan turntypelast{nullptr, 0};
+					for_each_token(turnlanes, "|;", [&](const ValueSpan& turntype) {
+						int priority=taglist.turn_command_priority(turntype);
+						if (!priority)
+							return false;
+
+						if (priority > prioritylast && !turntypelast.empty()) {
+							writer.writeWay(L_WP, way, "default", "%s has turn ...%.*s|%.*s...",
+								turnkey, turntypelast.width(), turntypelast.begin,
+								turntype.width(), turntype.begin);
+							return false;
+						}
+
+						prioritylast=priority;
+						turntypelast=turntype;
+						return true;
+					});
+				}
+
+				// TODO turn:lanes are from left to right. So in in Germany the first element cant be
+				// right if one of the next elements is less than right as that means crossing lanes
+				//
+				// We might assign "turn rate" and the next element must have a lower or same turn rate
+				//
+				// reverse	-> 40
+				// sharp_left	-> 20
+				// left		-> 18
+				// slight_left	-> 16
+				// through	-> 10	none, merge_to_left, merge_to_right
+				// slight_right	->  8
+				// right	->  6
+				// sharp_right	->  4
+			}
+
+
+			if (taglist.has_key("lanes") && taglist.has_key("lanes:forward") && taglist.has_key("lanes:backward")) {
+
+				int lanes=taglist.key_value_as_int("lanes");
+				int lanesfwd=taglist.key_value_as_int("lanes:forward");
+				int lanesbck=taglist.key_value_as_int("lanes:backward");
+
+				if (lanes != (lanesfwd + lanesbck)) {
+					writer.writeWay(L_WP, way, "default", "lanes=%d does not match sum of lanes:backward=%d and lanes:forward=%d",
+							lanes, lanesfwd, lanesbck);
+				}
+			}
+		}
+
+		// The values of the per lane keys - their count is checked by tag_lanes
+		void tag_lane_values(osmium::Way& way, extendedTagList& taglist) {
+			for(const auto& lanetag : lane_keys) {
+				const LaneValues	*destination=lane_values(taglist, lanetag.destination);
+
+				if (destination && destination->count > 1) {
+					const ValueSpan&	first=destination->lanes[0];
+					bool			same=!first.empty();
+
+					for(const auto& lane : *destination) {
+						if (lane.len != first.len || strncmp(lane.begin, first.begin, first.len))
+							same=false;
+					}
+
+					if (same) {
+						writer.writeWay(L_WP, way, "default", "%s=%s has the same destination on all lanes",
+							lanetag.destination, destination->value);
+					}
+				}
+
+				const LaneValues	*change=lane_values(taglist, lanetag.change);
+
+				if (change) {
+					for(const auto& lane : *change) {
+						if (!span_in_list(lane, valid_change_types)) {
+							writer.writeWay(L_WP, way, "default", "%s=%s contains %.*s which is unknown",
+								lanetag.change, change->value, lane.width(), lane.begin);
+						}
+					}
+				}
+
+				const LaneValues	*width=lane_values(taglist, lanetag.width);
+
+				if (width) {
+					for(const auto& lane : *width) {
+						// Lanes of unknown width may be left empty
+						if (lane.empty())
+							continue;
+
+						double		value;
+						const char	*end=parse_decimal(lane.begin, value);
+
+						if (end != lane.begin+lane.len || !(value > 0)) {
+							writer.writeWay(L_WP, way, "default", "%s=%s contains width %.*s which is not a positive number",
+								lanetag.width, width->value, lane.width(), lane.begin);
+						}
+					}
+				}
+			}
+		}
+
+		void tag_sidewalk(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("sidewalk"))
+				return;
+
+			if (!taglist.key_value_in_list("sidewalk", { "both", "left", "right", "none", "no", "yes", "separate" })) {
+				writer.writeWay(L_WP, way, "default", "sidewalk=%s not in known value list", taglist.get_value_by_key("sidewalk"));
+			}
+
+			/* sidewalk on motorway or trunk */
+			if (taglist.key_value_in_list("sidewalk", { "both", "left", "right", "yes" })) {
+				// Removed trunk_link - seems valid: Example https://www.openstreetmap.org/way/10871357
+				if (taglist.key_value_in_list("highway", { "motorway", "motorway_link", "trunk" })) {
+					writer.writeWay(L_WP, way, "default", "highway=%s and sidewalk=%s - most likely an error",
+						taglist.get_value_by_key("highway"),taglist.get_value_by_key("sidewalk"));
+				}
+				/* sidewalk on motorroad */
+				if (taglist.key_value_is_true("motorroad")) {
+					writer.writeWay(L_WP, way, "default", "motorroad=%s and sidewalk=%s - most likely an error",
+						taglist.get_value_by_key("motorroad"),taglist.get_value_by_key("sidewalk"));
+				}
+			}
+
+			// TODO - Sidewalk on cycleway, footway, path, track
+		}
+
+		void tag_segregated(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("segregated"))
+				return;
+
+			if (!taglist.key_value_in_list("highway", { "footway", "cycleway", "path" })) {
+				writer.writeWay(L_CYCLING, way, "default", "highway=%s and segregated=%s - segregated only used on foot/cycleway and path",
+					taglist.get_value_by_key("highway"),taglist.get_value_by_key("segregated"));
+			}
+			if (!taglist.key_value_in_list("segregated", { "yes", "no" })) {
+				writer.writeWay(L_WP, way, "default", "segregated=%s - value not in known value list",
+					taglist.get_value_by_key("segregated"));
+			}
+		}
+
+		void tag_shoulder(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key("shoulder")) {
+				if (!taglist.key_value_in_list("shoulder", { "both", "left", "right", "no", "yes" })) {
+					writer.writeWay(L_WP, way, "default", "shoulder=%s not in known value list", taglist.get_value_by_key("shoulder"));
+				}
+
+				if (taglist.key_value_in_list("highway", { "path", "footway", "cycleway", "track", "steps", "pedestrian", "bridleway" })) {
+					writer.writeWay(L_WP, way, "default", "highway=%s should not have shoulder=%s",
+						taglist.get_value_by_key("highway"), taglist.get_value_by_key("shoulder"));
+				}
+			}
+		}
+
+		void node_only_tags(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key("noexit")) {
+				writer.writeWay(L_WP, way, "default", "noexit=* should only be used on nodes");
+			}
+
+			if (taglist.key_value_in_list("highway", { "stop", "give_way",
+					"street_lamp", "traffic_lights", "traffic_calming",
+					"traffic_mirror", "speed_camera", "passing_place",
+					"mini_roundabout", "emergency_access_point", "bus_stop",
+					"turning_loop", "turning_circle", "toll_gantry" })) {
+
+				writer.writeWay(L_WP, way, "default", "highway=%s should only be used on nodes",
+						taglist.get_value_by_key("highway"));
+
+			}
+		}
+
+		void tag_oneway(osmium::Way& way, extendedTagList& taglist) {
+
+			if (taglist.key_value_is_false("oneway")) {
+				writer.writeWay(L_DEFAULTS, way, "redundant", "oneway=no is default");
+			}
+
+
+			/* Elements which only make sense on ANY oneway */
+			if (!taglist.has_key("oneway") || taglist.key_value_in_list("oneway", { "0", "no" })) {
+				static const char * const	lanekey[]={ "turn:lanes", "destination", "destination:lanes" };
+				for(auto key : lanekey) {
+					if (taglist.has_key(key)) {
+						writer.writeWay(L_WP, way, "default", "%s makes only sense on oneway streets", key);
+					}
+				}
+
+				static const char * const	cyclewaykeys[]={ "cycleway", "cycleway:left", "cycleway:right" };
+				for(auto key : cyclewaykeys) {
+					if (taglist.key_value_in_list(key, { "opposite", "opposite_lane", "opposite_track", "opposite_share_busway" })) {
+						writer.writeWay(L_CYCLING, way, "default", "%s=%s makes only sense on oneway streets",
+								key, taglist.get_value_by_key(key));
+					}
+				}
+			}
+
+			if (taglist.has_key("oneway")) {
+				/* Elements which dont make sense on oneway in ways direction*/
+				if (taglist.key_value_in_list("oneway", { "true", "yes", "1" })) {
+					static const char * const	keys[]={ "turn:lanes:backward", "destination:backward", "destination:lanes:backward", "maxspeed:backward" };
+					for(auto key : keys) {
+						if (taglist.has_key(key)) {
+							writer.writeWay(L_WP, way, "default", "%s on oneway=%s makes no sense",
+								key, taglist.get_value_by_key("oneway"));
+						}
+					}
+
+				}
+
+				/* Elements which dont make sense on reversed oneway */
+				if (taglist.key_value_in_list("oneway", { "-1" })) {
+					static const char * const	keys[]={ "turn:lanes:forward", "destination:forward", "destination:lanes:forward", "maxspeed:forward" };
+					for(auto key : keys) {
+						if (taglist.has_key(key)) {
+							writer.writeWay(L_WP, way, "default", "%s on oneway=%s makes no sense",
+								key, taglist.get_value_by_key("oneway"));
+						}
+					}
+				}
+			}
+		}
+
+		bool construction_osrm_whitelist(extendedTagList& taglist) {
+			return taglist.key_value_in_list("construction", { "no", "widening", "minor" });
+		}
+
+		void tag_proposed(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("proposed"))
+				return;
+
+			if (!taglist.has_key("highway"))
+				return;
+
+			writer.writeWay(L_WP, way, "default", "proposed=%s on highway=%s causes OSRM to avoid road",
+					taglist.get_value_by_key("highway"),
+					taglist.get_value_by_key("construction"));
+		}
+
+		void tag_construction(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("construction"))
+				return;
+
+			if (!taglist.has_key_value("highway", "construction")
+					&& !construction_osrm_whitelist(taglist)) {
+				writer.writeWay(L_WP, way, "default", "construction=%s on highway=%s",
+						taglist.get_value_by_key("highway"),
+						taglist.get_value_by_key("construction"));
+			}
+		}
+
+		void tag_tracktype(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("tracktype"))
+				return;
+
+			if (!taglist.has_key_value("highway", "track")) {
+				writer.writeWay(L_WP, way, "brownline", "tracktype=* on non track");
+			}
+
+			if (taglist.has_key("surface")) {
+				if (taglist.has_key_value("tracktype", "grade1")) {
+					if (!taglist.key_value_in_list("surface",
+							{ "paved", "cobblestone", "asphalt", "asphalt:lanes",
+							"paving_stones", "concrete", "concrete:lanes" })) {
+						writer.writeWay(L_WP, way, "brownline", "tracktype=%s with surface=%s is an suspicious combination",
+							taglist.get_value_by_key("tracktype"),
+							taglist.get_value_by_key("surface"));
+					}
+				}
+
+				if (taglist.key_value_in_list("tracktype", { "grade3", "grade4", "grade5" })) {
+					if (taglist.key_value_in_list("surface",
+							{ "paved", "cobblestone", "asphalt", "asphalt:lanes",
+							"paving_stones", "concrete", "concrete:lanes" })) {
+						writer.writeWay(L_WP, way, "brownline", "tracktype=%s with surface=%s is a suspicious combination",
+							taglist.get_value_by_key("tracktype"),
+							taglist.get_value_by_key("surface"));
+					}
+				}
+			}
+		}
+
+		void tag_junction(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("junction", "roundabout")) {
+				if (taglist.has_key("name")) {
+					writer.writeWay(L_WP, way, "default", "name on roundabout is most likely an error - should not carry name or any street");
+				}
+				if (taglist.has_key("ref")) {
+					writer.writeWay(L_WP, way, "default", "ref on roundabout is most likely an error - should not carry ref of any street");
+				}
+				if (taglist.has_key("oneway")) {
+					writer.writeWay(L_DEFAULTS, way, "redundant", "oneway on roundabout is default");
+				}
+				if (taglist.key_value_in_list("sidewalk", { "both", "yes", "left" })) {
+					writer.writeWay(L_WP, way, "default", "sidewalk=%s on roundabout - Right hand drive countries should have only a right sidewalk",
+							taglist.get_value_by_key("sidewalk"));
+				}
+				if (taglist.key_value_in_list("cycleway", { "opposite", "opposite_lane", "opposite_track" })) {
+					writer.writeWay(L_CYCLING, way, "default", "cycleway=%s on roundabout is broken",
+							taglist.get_value_by_key("cycleway"));
+				}
+			}
+
+			// TODO - junction compare against list
+			// TODO - check for turn direction
+		}
+
+		void tag_bicycle(osmium::Way& way, extendedTagList& taglist) {
+			const char *highway=taglist.get_value_by_key("highway");
+
+			if (taglist.has_key("bicycle")) {
+				const char *bikevalue=taglist.get_value_by_key("bicycle");
+
+				if (taglist.road_is_public() && !taglist.road_is_motorway()) {
+					if (taglist.key_value_is_true("bicycle")) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "bicycle=%s on highway=%s is default", bikevalue, highway);
+						writer.writeWay(L_CYCLING, way, "redundant", "bicycle=%s on highway=%s is default", bikevalue, highway);
+					} else if (taglist.has_key_value("bicycle", "permissive")) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "bicycle=designated on highway=%s is default - road is public", highway);
+						writer.writeWay(L_CYCLING, way, "redundant", "bicycle=designated on highway=%s is default - road is public", highway);
+					} else if (taglist.has_key_value("bicycle", "private")) {
+						writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on highway=%s is broken - road is public", bikevalue, highway);
+					} else if (taglist.has_key_value("bicycle", "customers")) {
+						writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on highway=%s is broken - road is public", bikevalue, highway);
+					} else if (taglist.has_key_value("bicycle", "destination")) {
+						writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on highway=%s is suspicious - StVO would allow vehicle=destination", bikevalue, highway);
+					}
+				}
+
+				if (taglist.key_value_in_list("highway", { "track", "service" })) {
+					if (taglist.key_value_is_true("bicycle")) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "bicycle=%s on highway=%s is redundant", bikevalue, highway);
+						writer.writeWay(L_CYCLING, way, "redundant", "bicycle=%s on highway=%s is redundant", bikevalue, highway);
+					}
+				}
+
+				if (taglist.key_value_in_list("highway", { "trunk", "trunk_link", "motorway", "motorway_link" })) {
+					if (taglist.key_value_in_list("bicycle", { "no", "0", "false" })) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "bicycle=%s on highway=%s is default", bikevalue, highway);
+						writer.writeWay(L_CYCLING, way, "redundant", "bicycle=%s on highway=%s is default", bikevalue, highway);
+					} else {
+						writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on highway=%s is broken", bikevalue, highway);
+					}
+				}
+
+				if (!taglist.key_value_in_list("bicycle", { "yes", "no", "private", "permissive",
+						"destination" , "designated", "use_sidepath", "dismount" })) {
+					writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on highway=%s", bikevalue, highway);
+				}
+			}
+		}
+
+		void tag_foot(osmium::Way& way, extendedTagList& taglist) {
+			const char *highway=taglist.get_value_by_key("highway");
+			if (taglist.has_key("foot")) {
+				const char *footvalue=taglist.get_value_by_key("foot");
+
+				if (taglist.road_is_public() && !taglist.road_is_motorway()) {
+					if (taglist.key_value_is_true("foot")) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "foot=%s on highway=%s is default", footvalue, highway);
+					} else if (taglist.has_key_value("foot", "permissive")) {
+						writer.writeWay(L_WP, way, "default", "foot=yes on highway=%s is default", highway);
+					} else if (taglist.has_key_value("foot", "private")) {
+						writer.writeWay(L_WP, way, "default", "foot=%s on highway=%s is broken - road is public", footvalue, highway);
+					} else if (taglist.has_key_value("foot", "customers")) {
+						writer.writeWay(L_WP, way, "default", "foot=%s on highway=%s is broken - road is public", footvalue, highway);
+					} else if (taglist.has_key_value("foot", "destination")) {
+						writer.writeWay(L_WP, way, "default", "foot=%s on highway=%s is broken - No way StVO can sign this", footvalue, highway);
+					}
+				}
+
+				if (taglist.key_value_in_list("highway", { "track", "service" })) {
+					if (taglist.key_value_is_true("foot")) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "foot=%s on highway=%s is default", footvalue, highway);
+					}
+				}
+
+				if (taglist.key_value_in_list("highway", { "trunk", "trunk_link", "motorway", "motorway_link" })) {
+					if (taglist.key_value_is_true("foot")) {
+						writer.writeWay(L_WP, way, "default", "foot=%s on highway=%s is broken", footvalue, highway);
+					}
+				}
+
+				if (!taglist.key_value_in_list("foot", { "yes", "no", "private", "permissive", "destination" , "designated", "use_sidepath" })) {
+					writer.writeWay(L_STRANGE, way, "default", "foot=%s on highway=%s", footvalue, highway);
+				}
+			}
+		}
+
+		void tag_motor_vehicle(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.key_value_is_true("motor_vehicle")) {
+				if (taglist.key_value_is_false("motorcycle")) {
+					writer.writeWay(L_WP, way, "default", "motor_vehicle=yes and motorcycle=no should be motorcar + hgv");
+				} else if (taglist.key_value_is_true("motorcycle")) {
+					writer.writeWay(L_DEFAULTS, way, "redundant", "motor_vehicle=yes includes motorcycle=yes");
+				}
+
+				if (taglist.key_value_is_false("motorcar")) {
+					writer.writeWay(L_WP, way, "default", "motor_vehicle=yes and motorcar=no should be motorcycle");
+				} else if (taglist.key_value_is_true("motorcar")) {
+					writer.writeWay(L_DEFAULTS, way, "redundant", "motor_vehicle=yes includes motorcar=yes");
+				}
+
+				if (taglist.key_value_is_false("hgv")) {
+					writer.writeWay(L_WP, way, "default", "motor_vehicle=yes and hgv=no should be motorcar");
+				} else if (taglist.key_value_is_true("hgv")) {
+					writer.writeWay(L_DEFAULTS, way, "redundant", "motor_vehicle=yes includes hgv=yes");
+				}
+			}
+		}
+
+		void tag_access(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key("access")) {
+				if (taglist.key_value_is_true("access")) {
+					writer.writeWay(L_DEFAULTS, way, "violetline", "access=yes is default");
+				} else {
+					if (taglist.road_is_public()) {
+						const char *accessvalue=taglist.get_value_by_key("access");
+						writer.writeWay(L_WP, way, "violetline", "access=%s - Nicht StVO konform. Vermutlich motor_vehicle=%s oder vehicle=%s",
+								accessvalue, accessvalue, accessvalue);
+					}
+				}
+			}
+		}
+
+		// footway=* is only defined for highway=footway
+		//
+		// Old values (both, left, right, none) are deprecated
+		//
+		void tag_footway(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("footway"))
+				return;
+
+			if (taglist.key_value_in_list("footway", { "both", "left", "right", "none" })) {
+				writer.writeWay(L_WP, way, "default", "footway=%s on highway=%s is deprecated - replaced by sidewalk=",
+					taglist.get_value_by_key("footway"), taglist.get_value_by_key("highway"));
+			} else {
+				if (!taglist.has_key_value("highway", "footway")) {
+					writer.writeWay(L_WP, way, "default", "footway=%s on non highway=footway",
+						taglist.get_value_by_key("footway"));
+				} else {
+					if (!taglist.key_value_in_list("footway", { "sidewalk", "crossing" })) {
+						writer.writeWay(L_WP, way, "default", "footway=%s is unknown value",
+							taglist.get_value_by_key("footway"));
+					}
+				}
+			}
+		}
+		void tag_overtaking(osmium::Way& way, extendedTagList& taglist) {
+				static const char * const	keys[]={ "overtaking", "overtaking:forward", "overtaking:backward" };
+
+				for(auto key : keys) {
+					if (!taglist.has_key(key))
+						continue;
+					if (!taglist.key_value_in_list(key, { "no", "yes", "caution", "both", "forward", "backward" })) {
+						writer.writeWay(L_WP, way, "default", "%s=%s value not in known list",
+							key, taglist[key]);
+					}
+					// TODO - lanes=1 - no overtaking
+					//        lanes:forward/lanes:backward/oneway?
+					// TODO - overtaking:hgv, overtaking:forward:hgv
+				}
+
+				if (taglist.key_value_in_list("overtaking:forward", { "both", "backward" })) {
+					writer.writeWay(L_WP, way, "default", "overtaking:forward=%s is broken",
+						taglist["overtaking:forward"]);
+					// TODO - oneway in opposite direction
+				}
+
+				if (taglist.key_value_in_list("overtaking:backward", { "both", "forward" })) {
+					writer.writeWay(L_WP, way, "default", "overtaking:backward=%s is broken",
+						taglist["overtaking:backward"]);
+					// TODO - oneway in opposite direction
+				}
+		}
+
+		void tag_cutting(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("cutting"))
+				return;
+
+			if (taglist.key_value_in_list("cutting", { "yes", "1", "true", "left", "right" })) {
+				if (taglist.is_tunnel()) {
+					writer.writeWay(L_WP, way, "default", "cutting=%s and tunnel=%s is broken",
+						taglist["cutting"], taglist["tunnel"]);
+				}
+				if (taglist.is_bridge()) {
+					writer.writeWay(L_WP, way, "default", "cutting=%s and bridge=%s is broken",
+						taglist["cutting"], taglist["bridge"]);
+				}
+			}
+		}
+
+		void tag_embankment(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("embankment"))
+				return;
+
+			if (taglist.key_value_is_true("embankment")) {
+				if (taglist.is_tunnel()) {
+					writer.writeWay(L_WP, way, "default", "embankment=%s and tunnel=%s is broken",
+						taglist["embankment"], taglist["tunnel"]);
+				}
+				if (taglist.is_bridge()) {
+					writer.writeWay(L_WP, way, "default", "embankment=%s and bridge=%s is broken",
+						taglist["embankment"], taglist["bridge"]);
+				}
+				if (taglist.key_value_in_list("cutting", { "yes", "1", "true" })) {
+					writer.writeWay(L_WP, way, "default", "embankment=%s and cutting=%s is broken",
+						taglist["embankment"], taglist["cutting"]);
+				}
+			}
+		}
+
+		void tag_lit(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("lit"))
+				return;
+
+			if (taglist.key_value_in_list("lit", { "yes", "limited", "24/7", "automatic" })
+				&& taglist.key_value_in_list("highway", { "track" })) {
+
+				writer.writeWay(L_STRANGE, way, "default", "lit=%s on highway=%s is strange",
+					taglist.get_value_by_key("lit"), taglist.get_value_by_key("highway"));
+			}
+		}
+
+		void tag_hazmat(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key("hazmat"))
+				return;
+
+			if (taglist.key_value_in_list("hazmat", { "yes", "destination", "designated" })) {
+
+				// Ways not beeing part of the "Gefahrgutstraßengrundnetz"
+				if (taglist.key_value_in_list("highway", { "track", "path", "footway", "cycleway", "pedestrian" })) {
+					writer.writeWay(L_WP, way, "default", "hazmat=%s on highway=%s is broken",
+						taglist.get_value_by_key("hazmat"), taglist.get_value_by_key("highway"));
+
+				// Ways most likely not beeing part of the "Gefahrgutstraßengrundnetz"
+				} else if (taglist.key_value_in_list("highway", { "living_street", "service" })) {
+					writer.writeWay(L_WP, way, "default", "hazmat=%s on highway=%s is suspicious",
+						taglist.get_value_by_key("hazmat"), taglist.get_value_by_key("highway"));
+				}
+
+				// hazmat allowed but not goods vehicles
+				if (taglist.key_value_in_list("hgv", { "no", "false", "0" })) {
+					writer.writeWay(L_WP, way, "default", "hazmat=%s with hgv=%s is suspicious",
+						taglist.get_value_by_key("hazmat"), taglist.get_value_by_key("hgv"));
+				}
+			}
+		}
+
+		void tag_goods(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key("goods")) {
+				writer.writeWay(L_WP, way, "default", "goods=* is not in use in Germany - did you mean hgv=");
+			}
+		}
+
+		void tag_stray(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key("entrance")) {
+				writer.writeWay(L_WP, way, "default", "entrance=* is not used on highways but on nodes");
+			}
+			if (taglist.has_key("waterway")) {
+				writer.writeWay(L_WP, way, "default", "waterway=%s is incompatible with a street",
+						taglist.get_value_by_key("waterway"));
+			}
+			if (taglist.has_key("building")) {
+				writer.writeWay(L_WP, way, "default", "building=%s is incompatible with a street",
+						taglist.get_value_by_key("building"));
+			}
+		}
+
+		void tag_cycleway(osmium::Way& way, extendedTagList& taglist) {
+			/* TODO
+			 * On non cycleway/paths cycleway may only be no/left/right/both
+			 */
+
+			if (taglist.key_value_in_list("cycleway:left", { "none", "no", "0" }) &&
+				taglist.key_value_in_list("cycleway:right", { "none", "no", "0" })) {
+
+				writer.writeWay(L_CYCLING, way, "default", "cycleway:left + cycleway:right are the same - should be cycleway=no");
+			}
+
+			bool	left=false,
+				right=false;
+
+			/* If we have cycleway:left/cycleway:right we need to have cycleway aswell */
+			if (taglist.has_key("cycleway:left")
+				&& !taglist.key_value_in_list("cycleway:left", { "none", "no", "0" })) {
+				left=true;
+			}
+			if (taglist.has_key("cycleway:right")
+				&& !taglist.key_value_in_list("cycleway:right", { "none", "no", "0" })) {
+				right=true;
+			}
+
+			if (left || right) {
+				if (!taglist.has_key("cycleway")) {
+					writer.writeWay(L_CYCLING, way, "default", "way has cycleway:left/right=* and no cycleway=*");
+				}
+				if (left && !right) {
+					if (!taglist.has_key_value("cycleway", "left")) {
+						writer.writeWay(L_CYCLING, way, "default", "way has cycleway:left=* and no cycleway=left");
+					}
+				} else if (!left && right) {
+					if (!taglist.has_key_value("cycleway", "right")) {
+						writer.writeWay(L_CYCLING, way, "default", "way has cycleway:right=* and no cycleway=right");
+					}
+				} else if (left && right) {
+					if (!taglist.has_key_value("cycleway", "both")) {
+						writer.writeWay(L_CYCLING, way, "default", "way has cycleway:right=* and left=* and no cycleway=both");
+					}
+				}
+			}
+
+			static const char * const	cycleways[]={ "cycleway:left ", "cycleway:right" };
+			for(auto cw : cycleways) {
+				if (taglist.has_key(cw) && !taglist.key_value_in_list(cw, { "sidepath", "track", "lane" })) {
+					writer.writeWay(L_CYCLING, way, "default", "%s=%s invalid combination",
+							cw, taglist.get_value_by_key(cw));
+				}
+			}
+
+			// TODO - Other values which might be the same
+		}
+
+		void tag_vehicle(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.key_value_is_true("vehicle")) {
+				if (taglist.key_value_is_false("motor_vehicle")) {
+					writer.writeWay(L_WP, way, "default", "vehicle=yes and motor_vehicle=no should be bicyle");
+				} else if (taglist.key_value_is_true("motor_vehicle")) {
+					writer.writeWay(L_DEFAULTS, way, "redundant", "vehicle=yes includes motor_vehicle=yes");
+				}
+			}
+		}
+
+		void highway_road(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("highway", "road")) {
+				writer.writeWay(L_WP, way, "default", "highway=road is only a temporary tagging for sat imagery based mapping");
+			}
+		}
+
+		void highway_footway(osmium::Way& way, extendedTagList& taglist) {
+			if (!taglist.has_key_value("highway", "footway"))
+				return;
+
+			if (!taglist.has_key("bicycle")) {
+				writer.writeWay(L_FOOTWAY, way, "footway", "highway=footway without bicycle=yes/no tag - suspicious combination");
+			}
+
+			if (taglist.has_key_value("bicycle", "use_sidepath")) {
+				writer.writeWay(L_CYCLING, way, "default", "bicycle=use_sidepath on cycleway is broken - should be on main road");
+			}
+
+			if (taglist.key_value_is_true("foot")) {
+				writer.writeWay(L_DEFAULTS, way, "redundant", "highway=footway with foot=yes is default");
+				writer.writeWay(L_FOOTWAY, way, "redundant", "highway=footway with foot=yes is default");
+			} else if (taglist.key_value_is_false("foot")) {
+				writer.writeWay(L_WP, way, "default", "highway=footway with foot=no is broken");
+				writer.writeWay(L_FOOTWAY, way, "default", "highway=footway with foot=no is broken");
+			}
+
+			/* TODO What about other access types vehicle/motor_vehicle/hgv/goods? yes/designated etc */
+		}
+
+		void highway_path(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("highway", "path")) {
+				if (taglist.has_key("cycleway")) {
+					if (taglist.key_value_in_list("cycleway", { "shared", "track" })) {
+						writer.writeWay(L_WP, way, "default", "highway=path with cycleway=%s tag should be on road or absent",
+								taglist.get_value_by_key("cycleway"));
+					} else {
+						writer.writeWay(L_WP, way, "default", "highway=path with cycleway=%s is unknown value",
+								taglist.get_value_by_key("cycleway"));
+					}
+				}
+			}
+
+			if (taglist.has_key_value("highway", "path")) {
+				static const char * const	multitrack[]={ "motorcar", "goods", "hgv", "psv", "motor_vehicle", "agricultural", "atv", "bus" };
+				for(auto key : multitrack) {
+					if (taglist.key_value_is_true(key)) {
+						writer.writeWay(L_WP, way, "default", "highway=path - %s=yes is suspicious - cant fit on single track path", key);
+					} else if (taglist.key_value_is_false(key)) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "highway=path - %s=no is default", key);
+					} else if (taglist.has_key_value(key, "permissive")) {
+						writer.writeWay(L_WP, way, "default", "highway=path - %s=permissive - cant fit on a single track path", key);
+					} else if (taglist.has_key_value(key, "private")) {
+						writer.writeWay(L_WP, way, "default", "highway=path - %s=private - cant fit on a single track path", key);
+					} else if (taglist.has_key_value(key, "agricultural")) {
+						writer.writeWay(L_WP, way, "default", "highway=path - %s=agricultural - cant fit on a single track path", key);
+					}
+				}
+				/* Broken tags - hazmat=no/yes bullshit */
+			}
+		}
+
+		void highway_service(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("highway", "service")) {
+				if (taglist.has_key("name")) {
+					writer.writeWay(L_WP, way, "default", "highway=service with name=* is suspicious - Either public e.g. not service or name tag abuse");
+				}
+			} else {
+				if (taglist.has_key("service")) {
+					writer.writeWay(L_WP, way, "default", "service=%s on non service highway", taglist.get_value_by_key("service"));
+				}
+			}
+		}
+
+		void highway_living_street(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("highway", "living_street")) {
+				if (taglist.has_key("maxspeed")) {
+					writer.writeWay(L_WP, way, "steelline", "maxspeed=%s on living_street is broken - neither numeric nor walk is correct",
+							taglist.get_value_by_key("maxspeed"));
+					// TODO - maxspeed:vehicle, maxspeed:motor_vehicle, maxspeed:hgv, maxspeed:motorcar, maxspeed:motorcycle etc
+				}
+
+				if (taglist.has_key_value("bicycle", "use_sidepath")) {
+					writer.writeWay(L_CYCLING, way, "default", "bicycle=use_sidepath on living_street is broken - living_street explicitly includes bicycles");
+				}
+
+				static const char * const	defaultyes[]={ "vehicle" };
+				for(auto key : defaultyes) {
+					if (taglist.key_value_is_false(key)) {
+						writer.writeWay(L_WP, way, "default", "living_street with %s=no is broken", key);
+					} else if (taglist.key_value_is_true(key)) {
+						writer.writeWay(L_DEFAULTS, way, "redundant", "living_street with %s=yes is default", key);
+					}
+				}
+			}
+		}
+
+		void highway_track(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.has_key_value("highway", "track")) {
+				if (taglist.has_key("name")) {
+					writer.writeWay(L_WP, way, "brownline", "highway=track with name is suspicious - probably not track");
+				}
+				if (taglist.has_key("maxspeed")) {
+					writer.writeWay(L_WP, way, "steelline", "highway=track with maxspeed is suspicious - probably not track");
+				}
+
+				static const char * const	defaultno[]={ "motorcycle", "motorcar", "hgv", "psv", "motor_vehicle", "vehicle" };
+				for(auto key : defaultno) {
+					if (taglist.key_value_is_false(key)) {
+						writer.writeWay(L_WP, way, "brownline", "highway=track - %s=no is suspicious - should be agricutural or empty", key);
+					}
+				}
+			}
+		}
+
+		void highway_cycleway(osmium::Way& way, extendedTagList& taglist) {
+
+			if (!taglist.has_key_value("highway", "cycleway"))
+				return;
+
+			static const char * const	defno[]={ "motor_vehicle", "motorcar", "motorcycle", "hgv", "psv", "horse", "foot" };
+			for(auto key : defno) {
+				if (taglist.key_value_is_false(key)) {
+					writer.writeWay(L_CYCLING, way, "redundant", "%s=%s on cycleway is default",
+							key, taglist.get_value_by_key(key));
+				}
+			}
+
+			if (taglist.has_key_value("vehicle", "no")) {
+				writer.writeWay(L_CYCLING, way, "default", "vehicle=no on cycleway is broken as bicycle is a vehicle");
+			}
+
+			/*
+			 * FIXME - Luebecker Modell sieht das vor.
+			if (taglist.key_value_in_list("bicycle", { "designated" })) {
+				writer.writeWay(L_CYCLING, way, "redundant", "bicycle=%s on cycleway is default",
+						taglist.get_value_by_key("bicycle"));
+			}
+			*/
+
+			if (taglist.key_value_in_list("bicycle", { "no", "0", "false", "private", "permissive",
+					"use_sidepath", "destination", "customers", "unknown", "lane",
+					"allowed", "limited",  })) {
+				writer.writeWay(L_CYCLING, way, "default", "bicycle=%s on cycleway is broken",
+						taglist.get_value_by_key("bicycle"));
+			}
+
+			if (taglist.has_key_value("bicycle", "use_sidepath")) {
+				writer.writeWay(L_CYCLING, way, "default", "cycleway=track and bicycle=use_sidepath on road is broken as there is no seperate cycleway");
+			}
+		}
+
+		static bool highway_wecare(extendedTagList& taglist) {
+			if (!taglist.has_key("highway")) {
+				return false;
+			}
+
+			if (!taglist.string_in_list(taglist.get_value_by_key("highway"), highway_valid_list)) {
+				//std::cerr << "Unknown highway type " << taglist.get_value_by_key("highway") << std::endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		void public_access(osmium::Way& way, extendedTagList& taglist) {
+			if (taglist.road_is_public()) {
+				static const char * const	accesstags[]={
+					"access", "vehicle", "motor_vehicle", "motorcycle",
+					"motorcar", "hgv", "psv",
+					"goods", "mofa", "moped", "horse"};
+
+				for(auto key : accesstags) {
+					const char *value=taglist[key];
+					const char *highway=taglist["highway"];
+
+					if (!value)
+						continue;
+
+					if (!strcmp(value, "permissive")) {
+						writer.writeWay(L_WP, way, "violetline", "highway=%s is public way - cant have %s=permissive access tags", highway, key);
+					} else if (!strcmp(value, "private")) {
+						writer.writeWay(L_WP, way, "violetline", "highway=%s is public way - cant have %s=private access tags", highway, key);
+					} else if (!strcmp(value, "customers")) {
+						writer.writeWay(L_WP, way, "violetline", "highway=%s is public way - cant have %s=customers access tags", highway, key);
+					}
+				}
+			}
+		}
+
+		/*
+		 * All checks in the order they are run on a way. A check is only
+		 * called when the way has one of its space separated keys - the
+		 * ones without keys look at highway or the nodes and always run.
+		 * tag_rules does its own dispatch by key.
+		 */
+		struct Check {
+			const char	*name;
+			void		(WayHandler::*function)(osmium::Way&, extendedTagList&);
+			const char	*keys;
+		};
+
+		// All checks but circular_way only look at the tags
+		static bool tags_only(const Check& check) {
+			return check.function != &WayHandler::circular_way;
+		}
+
+		static check_mask all_checks() {
+			return checks().size() < 64 ? (check_mask(1) << checks().size())-1 : ~check_mask(0);
+		}
+
+		static check_mask node_checks() {
+			static const check_mask	mask=[]() {
+				check_mask	result=0;
+				for(size_t i=0;i<checks().size();i++) {
+					if (!tags_only(checks()[i]))
+						result|=check_mask(1) << i;
+				}
+				return result;
+			}();
+			return mask;
+		}
+
+		static const CheckDispatch& dispatch() {
+			static const CheckDispatch	table=[]() {
+				std::vector<const char *>	keys;
+				for(const auto& check : checks()) {
+					keys.push_back(check.keys);
+				}
+				return CheckDispatch(keys);
+			}();
+			return table;
+		}
+
+		// Mask of a comma separated list of check names
+		static check_mask check_names(const std::string& list) {
+			std::vector<std::string>	names;
+			check_mask			result=0;
+
+			boost::split(names, list, boost::is_any_of(","), boost::token_compress_on);
+			for(const auto& name : names) {
+				if (name.empty())
+					continue;
+
+				auto it=std::find_if(checks().begin(), checks().end(),
+					[&](const Check& check) { return name == check.name; });
+				if (it == checks().end())
+					throw std::invalid_argument("unknown check " + name);
+				result|=check_mask(1) << (it-checks().begin());
+			}
+			return result;
+		}
+
+		static const std::vector<Check>& checks() {
+			static const std::vector<Check> list {
+				{ "circular_way", &WayHandler::circular_way, "" },
+
+				{ "tag_rules", &WayHandler::tag_rules, "" },
+				{ "tag_ref", &WayHandler::tag_ref, "" },
+				{ "tag_maxspeed", &WayHandler::tag_maxspeed,
+					"maxspeed maxspeed:hgv maxspeed:vehicle maxspeed:motor_vehicle maxspeed:bus "
+					"maxspeed:forward maxspeed:forward:hgv maxspeed:forward:vehicle maxspeed:forward:motor_vehicle maxspeed:forward:bus "
+					"maxspeed:backward maxspeed:backward:hgv maxspeed:backward:vehicle maxspeed:backward:motor_vehicle maxspeed:backward:bus" },
+				{ "tag_maxheight", &WayHandler::tag_maxheight, "maxheight" },
+				{ "tag_lanes", &WayHandler::tag_lanes, "lanes lanes:forward lanes:backward" },		// turn:lanes, destination:lanes
+				{ "tag_lane_values", &WayHandler::tag_lane_values,
+					"destination:lanes destination:lanes:forward destination:lanes:backward "
+					"change:lanes change:lanes:forward change:lanes:backward "
+					"width:lanes width:lanes:forward width:lanes:backward" },
+				{ "tag_sidewalk", &WayHandler::tag_sidewalk, "sidewalk" },
+				{ "tag_segregated", &WayHandler::tag_segregated, "segregated" },
+				{ "tag_shoulder", &WayHandler::tag_shoulder, "shoulder" },
+				{ "tag_oneway", &WayHandler::tag_oneway, "oneway turn:lanes destination destination:lanes cycleway cycleway:left cycleway:right" },
+				{ "tag_construction", &WayHandler::tag_construction, "construction" },
+				{ "tag_proposed", &WayHandler::tag_proposed, "proposed" },
+				{ "tag_tracktype", &WayHandler::tag_tracktype, "tracktype" },
+				{ "tag_junction", &WayHandler::tag_junction, "junction" },
+				{ "tag_footway", &WayHandler::tag_footway, "footway" },
+				{ "tag_hazmat", &WayHandler::tag_hazmat, "hazmat" },
+				{ "tag_lit", &WayHandler::tag_lit, "lit" },
+				{ "tag_embankment", &WayHandler::tag_embankment, "embankment" },
+				{ "tag_cutting", &WayHandler::tag_cutting, "cutting" },
+				{ "tag_overtaking", &WayHandler::tag_overtaking, "overtaking overtaking:forward overtaking:backward" },
+				{ "tag_maxwidth", &WayHandler::tag_maxwidth, "maxwidth" },
+				{ "tag_type", &WayHandler::tag_type, "type" },
+
+				{ "tag_source_maxspeed", &WayHandler::tag_source_maxspeed, "source:maxspeed" },
+				{ "tag_maxspeed_source", &WayHandler::tag_maxspeed_source, "maxspeed:source" },
+				{ "tag_maxspeed_type", &WayHandler::tag_maxspeed_type, "maxspeed:type" },
+
+				{ "node_only_tags", &WayHandler::node_only_tags, "" },
+
+				// TODO - surface
+				// TODO - smoothness
+				// TODO - incline
+				// TODO - trafic_calming (on ways)
+				// TODO - driving_side
+				// TODO - abutters
+				// TODO - maxspeed:conditional
+				// TODO - maxspeed:source
+				// TODO - cycleway, cycleway:right, cycleway:left
+				// TODO - parking:lane
+				// TODO - lanes:both_ways!??
+				// TODO - maxaxleload
+				// TODO - maxlength
+				// TODO - maxwidth
+				// TODO - maxwidth:physical
+				// TODO - covered
+
+				{ "tag_bicycle", &WayHandler::tag_bicycle, "bicycle" },
+				{ "tag_foot", &WayHandler::tag_foot, "foot" },
+				{ "tag_access", &WayHandler::tag_access, "access" },
+				{ "tag_goods", &WayHandler::tag_goods, "goods" },
+				{ "tag_motor_vehicle", &WayHandler::tag_motor_vehicle, "motor_vehicle" },
+				{ "tag_vehicle", &WayHandler::tag_vehicle, "vehicle" },
+				{ "tag_cycleway", &WayHandler::tag_cycleway, "cycleway:left cycleway:right" },
+
+				{ "tag_stray", &WayHandler::tag_stray, "entrance waterway building" },
+				// TODO - psv
+				// TODO - motorcycle
+				// TODO - hgv
+				// TODO - forestry
+				// TODO - agricultural
+				// TODO - wheelchair
+
+				{ "highway_road", &WayHandler::highway_road, "" },
+				{ "highway_footway", &WayHandler::highway_footway, "" },
+				{ "highway_cycleway", &WayHandler::highway_cycleway, "" },
+				{ "highway_path", &WayHandler::highway_path, "" },
+				{ "highway_living_street", &WayHandler::highway_living_street, "" },
+				{ "highway_service", &WayHandler::highway_service, "" },
+				{ "highway_track", &WayHandler::highway_track, "" },
+
+				// steps
+				// escalators
+				// pedestrian
+
+				{ "public_access", &WayHandler::public_access, "access vehicle motor_vehicle motorcycle motorcar hgv psv goods mofa moped horse" },
+			};
+			return list;
+		}
+
+		void check_way(osmium::Way& way) {
+			extendedTagList	taglist(way.tags());
+
+			// Nothing of the last way is used any more
+			arena.reset();
+			lanevaluecount=0;
+
+			/* Skip highway=bus_stop */
+			if (!highway_wecare(taglist))
+				return;
+
+			check_mask	mask=dispatch().checks(way.tags()) & enabled;
+
+			if (!memo.enabled()) {
+				run_checks(way, taglist, mask);
+				return;
+			}
+
+			const std::vector<Problem>	*problems=memo.find(way.tags());
+
+			// circular_way is the first check so the order stays the same
+			run_checks(way, taglist, mask & node_checks());
+
+			if (problems) {
+				for(const auto& p : *problems) {
+					writer.addProblem(p);
+					if (stats)
+						stats->layers[p.lid]++;
+				}
+			} else {
+				size_t	first=writer.pending();
+
+				run_checks(way, taglist, mask & ~node_checks());
+				memo.store(writer, first);
+			}
+
+			if (stats)
+				(problems ? stats->memo_hits : stats->memo_misses)++;
+		}
+
+		// Run the checks of the mask - lowest bit first keeps the order of checks()
+		void run_checks(osmium::Way& way, extendedTagList& taglist, check_mask mask) {
+			while (mask) {
+				size_t	i=__builtin_ctzll(mask);
+
+				mask&=mask-1;
+
+				if (stats) {
+					run_check_stats(i, way, taglist);
+				} else {
+					(this->*checks()[i].function)(way, taglist);
+				}
+			}
+		}
+
+		// Same as above but with counters and timing
+		void run_check_stats(size_t i, osmium::Way& way, extendedTagList& taglist) {
+			CheckCounter&	counter=stats->checks[i];
+			size_t		problems=writer.pending();
+			auto		start=std::chrono::steady_clock::now();
+
+			(this->*checks()[i].function)(way, taglist);
+
+			counter.time+=std::chrono::steady_clock::now()-start;
+			counter.calls++;
+
+			for(size_t p=problems;p<writer.pending();p++) {
+				counter.problems++;
+				stats->layers[writer.pending_layer(p)]++;
+			}
+		}
+
+		// Unchanged ways replay their problems from the last run
+		void cached_way(osmium::Way& way) {
+			extendedTagList	taglist(way.tags());
+
+			if (!highway_wecare(taglist))
+				return;
+
+			// Without versions changed ways can not be told apart
+			if (way.version() == 0) {
+				check_way(way);
+				return;
+			}
+
+			uint64_t	lochash=ResultCache::location_hash(way);
+
+			if (!cache->replay(way, lochash, writer))
+				check_way(way);
+
+			cache->add(way, lochash, writer);
+		}
+
+		void way(osmium::Way& way) {
+			if (cache) {
+				cached_way(way);
+			} else {
+				check_way(way);
+			}
+
+			// Build the geometry once for all problems of the way
+			writer.finishWay(way);
+		}
+};
+
+/*
+ * Network checks - NetworkCollector runs behind the location handler and
+ * keeps the highways, railways and waterways with their nodes. The checks
+ * run on this copy after all ways were read. It takes 24 bytes per way and
+ * 16 bytes per node so a whole country fits into memory.
+ */
+enum network_flags : uint16_t {
+	NF_HIGHWAY=0x01,
+	NF_RAILWAY=0x02,
+	NF_WATERWAY=0x04,
+	NF_KIND=0x07,
+	NF_BRIDGE=0x08,
+	NF_TUNNEL=0x10,
+	NF_PUBLIC=0x20,
+	NF_VEHICLE=0x40,		// Public roads and service roads
+	NF_ONEWAY=0x80,
+	NF_REVERSE=0x100,		// oneway=-1 - only set with NF_ONEWAY
+	NF_LINK=0x200
+};
+
+static const char * const network_railway_list[] {
+	"rail", "light_rail", "narrow_gauge", "subway", "tram"
+};
+
+static const char * const network_waterway_list[] {
+	"river", "stream", "canal", "drain", "ditch"
+};
+
+struct NetworkWay {
+	osmium::object_id_type	id;
+	uint64_t		first;		// First node in NetworkCollector::nodes
+	int8_t			layer;
+	uint16_t		flags;
+};
+
+struct NetworkNode {
+	osmium::object_id_type	id;
+	osmium::Location	location;
+};
+
+// Where a tagged node has to be
+enum network_point_rule : uint8_t {
+	NP_ONROAD,
+	NP_NEARJUNCTION,
+	NP_JUNCTION,
+	NP_END
+};
+
+static const table_entry<network_point_rule> network_point_highway[] {
+	{ "crossing", NP_ONROAD },
+	{ "give_way", NP_NEARJUNCTION },
+	{ "mini_roundabout", NP_JUNCTION },
+	{ "motorway_junction", NP_JUNCTION },
+	{ "stop", NP_NEARJUNCTION },
+	{ "traffic_signals", NP_ONROAD },
+	{ "turning_circle", NP_END },
+	{ "turning_loop", NP_END },
+};
+
+struct NetworkPoint {
+	osmium::object_id_type	id;
+	osmium::Location	location;
+	const char		*key;
+	const char		*value;
+	network_point_rule	rule;
+};
+
+inline const char *network_kind_name(uint16_t flags) {
+	if (flags & NF_HIGHWAY)
+		return "highway";
+	if (flags & NF_RAILWAY)
+		return "railway";
+	return "waterway";
+}
+
+class NetworkCollector : public osmium::handler::Handler {
+	public:
+		std::vector<NetworkWay>		ways;
+		std::vector<NetworkNode>	nodes;
+		std::vector<NetworkPoint>	points;
+
+		// NF_HIGHWAY, NF_RAILWAY or NF_WATERWAY - 0 if the way is not part of the network
+		static uint16_t kind(extendedTagList& taglist) {
+			if (WayHandler::highway_wecare(taglist)) {
+				// The outline of a pedestrian area is not a way to walk along
+				if (taglist.key_value_is_true("area"))
+					return 0;
+				return NF_HIGHWAY;
+			}
+			if (taglist.string_in_list(taglist.get_value_by_key("railway"), network_railway_list))
+				return NF_RAILWAY;
+			if (taglist.string_in_list(taglist.get_value_by_key("waterway"), network_waterway_list))
+				return NF_WATERWAY;
+			return 0;
+		}
+
+		void way(const osmium::Way& way) {
+			extendedTagList	taglist(way.tags());
+			uint16_t	flags=kind(taglist);
+
+			if (!flags || way.nodes().size() < 2)
+				return;
+
+			if (taglist.has_key("bridge") && !taglist.key_value_is_false("bridge"))
+				flags|=NF_BRIDGE;
+			if (taglist.has_key("tunnel") && !taglist.key_value_is_false("tunnel"))
+				flags|=NF_TUNNEL;
+			if ((flags & NF_HIGHWAY) && taglist.road_is_public())
+				flags|=NF_PUBLIC;
+			if ((flags & NF_HIGHWAY) && (taglist.road_is_public() || taglist.has_key_value("highway", "service")))
+				flags|=NF_VEHICLE;
+			if ((flags & NF_HIGHWAY) && strstr(taglist.get_value_by_key("highway"), "_link"))
+				flags|=NF_LINK;
+
+			// Roundabouts and motorways are oneways unless tagged otherwise
+			if (taglist.key_value_is_true("oneway")) {
+				flags|=NF_ONEWAY;
+			} else if (taglist.has_key_value("oneway", "-1")) {
+				flags|=NF_ONEWAY|NF_REVERSE;
+			} else if (!taglist.has_key("oneway")
+					&& (taglist.key_value_in_list("junction", { "roundabout", "circular" })
+						|| taglist.has_key_value("highway", "motorway"))) {
+				flags|=NF_ONEWAY;
+			}
+
+			// Broken layer values are reported by the rules - take them as layer 0
+			int	layer=taglist.key_value_as_int("layer");
+			if (layer == std::numeric_limits<int>::max())
+				layer=0;
+			layer=layer < -128 ? -128 : (layer > 127 ? 127 : layer);
+
+			ways.push_back(NetworkWay{way.id(), nodes.size(), static_cast<int8_t>(layer), flags});
+			for(const auto& nr : way.nodes()) {
+				nodes.push_back(NetworkNode{nr.ref(), nr.location()});
+			}
+		}
+
+		void node(const osmium::Node& node) {
+			if (node.tags().empty())
+				return;
+
+			const char	*highway=node.tags()["highway"];
+			if (highway) {
+				auto entry=table_lookup(network_point_highway, highway);
+				if (entry)
+					points.push_back(NetworkPoint{node.id(), node.location(), "highway", entry->key, entry->value});
+			}
+
+			if (node.tags().has_tag("noexit", "yes"))
+				points.push_back(NetworkPoint{node.id(), node.location(), "noexit", "yes", NP_END});
+		}
+
+		// The nodes of a way end where the next way starts
+		const NetworkNode *begin(size_t way) const {
+			return nodes.data()+ways[way].first;
+		}
+
+		const NetworkNode *end(size_t way) const {
+			return nodes.data()+(way+1 < ways.size() ? ways[way+1].first : nodes.size());
+		}
+};
+
+inline void network_problem(std::vector<NetworkProblem>& problems, netlayerid lid, const char *style,
+		osmium::object_id_type id, osmium::object_id_type other, OGRGeometry *geometry, const char *format, ...) {
+	char		problem[256];
+	va_list		args;
+
+	va_start(args, format);
+	vsnprintf (problem, 255, format, args);
+	va_end (args);
+
+	problems.push_back(NetworkProblem{lid, style, problem, id, other, std::unique_ptr<OGRGeometry>(geometry)});
+}
+
+/*
+ * Crossings of network segments which do not share a node. The segments are
+ * sorted into the tiles of a fixed grid and every tile is swept along x on
+ * its own. Only the segments of one tile per thread are in memory and the
+ * tiles are spread over the threads. A crossing seen by more than one tile
+ * is only reported by the tile containing the crossing point.
+ */
+class NetworkCrossings {
+	static const int64_t	tilesize=500000;	// 0.05 degrees
+	static const uint32_t	tilerows=3601;
+
+	struct Segment {
+		int32_t		x1, y1, x2, y2;		// x1 <= x2
+		uint32_t	way;
+	};
+
+	const NetworkCollector	&network;
+
+	// The ways touching a tile - tile in the upper, way in the lower 32 bits
+	std::vector<uint64_t>	tileways;
+
+	static uint32_t tilex(int64_t x) {
+		return static_cast<uint32_t>((x+1800000000)/tilesize);
+	}
+
+	static uint32_t tiley(int64_t y) {
+		return static_cast<uint32_t>((y+900000000)/tilesize);
+	}
+
+	static uint32_t tile(int64_t x, int64_t y) {
+		return tilex(x)*tilerows+tiley(y);
+	}
+
+	// Calls function(a, b) for every segment of the way
+	template <typename TFunction>
+	void segments(size_t way, TFunction function) const {
+		const NetworkNode	*end=network.end(way);
+
+		for(const NetworkNode *n=network.begin(way);n+1 != end;n++) {
+			if (!n->location.valid() || !n[1].location.valid() || n->location == n[1].location)
+				continue;
+			function(n->location, n[1].location);
+		}
+	}
+
+	// Side of the point relative to the segment - exact as the products
+	// of the coordinate differences do not fit into 64 bits
+	static int side(const Segment& s, int32_t x, int32_t y) {
+		__int128	v=static_cast<__int128>(int64_t(s.x2)-s.x1)*(int64_t(y)-s.y1)
+				 -static_cast<__int128>(int64_t(s.y2)-s.y1)*(int64_t(x)-s.x1);
+
+		return (v > 0) - (v < 0);
+	}
+
+	static bool before(const Segment& a, const Segment& b) {
+		return std::tie(a.way, a.x1, a.y1, a.x2, a.y2) < std::tie(b.way, b.x1, b.y1, b.x2, b.y2);
+	}
+
+	template <typename TFunction>
+	void cross(uint32_t key, const Segment& s1, const Segment& s2, TFunction& function) const {
+		// Same order in every tile so every tile computes the same point
+		const Segment&	a=before(s1, s2) ? s1 : s2;
+		const Segment&	b=before(s1, s2) ? s2 : s1;
+
+		int	b1=side(a, b.x1, b.y1);
+		int	b2=side(a, b.x2, b.y2);
+		if (b1*b2 >= 0)
+			return;
+		if (side(b, a.x1, a.y1)*side(b, a.x2, a.y2) >= 0)
+			return;
+
+		double	ax=a.x2-double(a.x1), ay=a.y2-double(a.y1);
+		double	bx=b.x2-double(b.x1), by=b.y2-double(b.y1);
+		double	t=((b.x1-double(a.x1))*by-(b.y1-double(a.y1))*bx)/(ax*by-ay*bx);
+		int64_t	x=std::llround(a.x1+t*ax);
+		int64_t	y=std::llround(a.y1+t*ay);
+
+		if (tile(x, y) != key)
+			return;
+
+		function(network.ways[a.way], network.ways[b.way], osmium::Location(static_cast<int32_t>(x), static_cast<int32_t>(y)));
+	}
+
+	template <typename TFunction>
+	void sweep(uint32_t key, const uint64_t *begin, const uint64_t *end,
+			std::vector<Segment>& tilesegments, std::vector<uint32_t>& active, TFunction& function) const {
+		uint32_t	tx=key/tilerows, ty=key%tilerows;
+
+		tilesegments.clear();
+		for(const uint64_t *i=begin;i!=end;i++) {
+			uint32_t	way=static_cast<uint32_t>(*i);
+
+			segments(way, [&](osmium::Location a, osmium::Location b) {
+				if (a.x() > b.x())
+					std::swap(a, b);
+				if (tilex(a.x()) > tx || tilex(b.x()) < tx)
+					return;
+				if (tiley(std::min(a.y(), b.y())) > ty || tiley(std::max(a.y(), b.y())) < ty)
+					return;
+				tilesegments.push_back(Segment{a.x(), a.y(), b.x(), b.y(), way});
+			});
+		}
+
+		std::sort(tilesegments.begin(), tilesegments.end(), [](const Segment& a, const Segment& b) {
+			return a.x1 < b.x1;
+		});
+
+		active.clear();
+		for(uint32_t i=0;i<tilesegments.size();i++) {
+			const Segment&	s=tilesegments[i];
+			int32_t		sy1=std::min(s.y1, s.y2), sy2=std::max(s.y1, s.y2);
+			size_t		kept=0;
+
+			for(uint32_t j : active) {
+				const Segment&	o=tilesegments[j];
+
+				// Ends left of this segment - so it ends left of all following
+				if (o.x2 < s.x1)
+					continue;
+				active[kept++]=j;
+
+				if (o.way != s.way && std::max(o.y1, o.y2) >= sy1 && std::min(o.y1, o.y2) <= sy2)
+					cross(key, o, s, function);
+			}
+			active.resize(kept);
+			active.push_back(i);
+		}
+	}
+
+	public:
+		explicit NetworkCrossings(const NetworkCollector& network) : network(network) {
+			std::vector<uint32_t>	waytiles;
+
+			if (network.ways.size() > std::numeric_limits<uint32_t>::max())
+				throw std::runtime_error("too many ways in the network");
+
+			for(size_t way=0;way<network.ways.size();way++) {
+				waytiles.clear();
+				segments(way, [&](osmium::Location a, osmium::Location b) {
+					for(uint32_t x=tilex(std::min(a.x(), b.x()));x<=tilex(std::max(a.x(), b.x()));x++) {
+						for(uint32_t y=tiley(std::min(a.y(), b.y()));y<=tiley(std::max(a.y(), b.y()));y++) {
+							waytiles.push_back(x*tilerows+y);
+						}
+					}
+				});
+
+				std::sort(waytiles.begin(), waytiles.end());
+				waytiles.erase(std::unique(waytiles.begin(), waytiles.end()), waytiles.end());
+				for(uint32_t t : waytiles) {
+					tileways.push_back(static_cast<uint64_t>(t) << 32 | way);
+				}
+			}
+
+			std::sort(tileways.begin(), tileways.end());
+		}
+
+		/*
+		 * Calls function(way, otherway, location) for every crossing. Each
+		 * thread has its own function which is created by factory(thread).
+		 */
+		template <typename TFactory>
+		void run(unsigned int threads, TFactory factory) const {
+			std::atomic<size_t>		next{0};
+			std::vector<std::thread>	workers;
+
+			// Batches of tiles - dense tiles are mostly next to each other
+			static const size_t	batch=256;
+
+			auto worker=[&](unsigned int num) {
+				auto			function=factory(num);
+				std::vector<Segment>	tilesegments;
+				std::vector<uint32_t>	active;
+
+				while (true) {
+					size_t	start=next.fetch_add(batch);
+					if (start >= tileways.size())
+						return;
+
+					// Start and end on the first entry of a tile
+					const uint64_t	*begin=tileways.data()+start;
+					const uint64_t	*end=tileways.data()+std::min(start+batch, tileways.size());
+					const uint64_t	*last=tileways.data()+tileways.size();
+
+					while (begin != tileways.data() && begin != last && (*begin >> 32) == (begin[-1] >> 32))
+						begin++;
+					while (end != last && (*end >> 32) == (end[-1] >> 32))
+						end++;
+
+					while (begin < end) {
+						uint32_t	key=static_cast<uint32_t>(*begin >> 32);
+						const uint64_t	*tileend=begin;
+
+						while (tileend != end && (*tileend >> 32) == key)
+							tileend++;
+
+						sweep(key, begin, tileend, tilesegments, active, function);
+						begin=tileend;
+					}
+				}
+			};
+
+			for(unsigned int i=1;i<threads;i++) {
+				workers.emplace_back(worker, i);
+			}
+			worker(0);
+
+			for(auto& t : workers) {
+				t.join();
+			}
+		}
+};
+
+/*
+ * Layering of crossing ways - a bridge has to be above the way it crosses
+ * and a tunnel below. A highway crossing a railway or waterway on the same
+ * layer is missing a bridge, a tunnel or the shared node. Two plain highways
+ * crossing each other are left to check_crossing.
+ */
+inline void check_layering(const NetworkWay& a, const NetworkWay& b, osmium::Location location, std::vector<NetworkProblem>& problems) {
+	if (!((a.flags | b.flags) & NF_HIGHWAY))
+		return;
+
+	const NetworkWay	*x=&a, *y=&b;
+	for(int i=0;i<2;i++, std::swap(x, y)) {
+		if ((x->flags & NF_BRIDGE) && !(y->flags & NF_BRIDGE) && x->layer <= y->layer) {
+			network_problem(problems, N_LAYERING, "default", x->id, y->id, new OGRPoint(location.lon(), location.lat()),
+				"Bridge on layer %d is not above the crossing %s on layer %d", x->layer, network_kind_name(y->flags), y->layer);
+			return;
+		}
+		if ((x->flags & NF_TUNNEL) && !(y->flags & NF_TUNNEL) && x->layer >= y->layer) {
+			network_problem(problems, N_LAYERING, "default", x->id, y->id, new OGRPoint(location.lon(), location.lat()),
+				"Tunnel on layer %d is not below the crossing %s on layer %d", x->layer, network_kind_name(y->flags), y->layer);
+			return;
+		}
+	}
+
+	if (a.layer != b.layer)
+		return;
+
+	if (!((a.flags | b.flags) & (NF_BRIDGE|NF_TUNNEL)) && (a.flags & NF_KIND) == (b.flags & NF_KIND))
+		return;
+
+	// The highway first
+	if (!(a.flags & NF_HIGHWAY))
+		std::swap(x, y);
+
+	network_problem(problems, N_LAYERING, "default", x->id, y->id, new OGRPoint(location.lon(), location.lat()),
+		"Crossing %s on the same layer %d without a shared node", network_kind_name(y->flags), y->layer);
+}
+
+/*
+ * Two highways crossing on the same layer without a shared node - neither
+ * can be routed onto the other. Bridges and tunnels are left to the
+ * layering check.
+ */
+inline void check_crossing(const NetworkWay& a, const NetworkWay& b, osmium::Location location, std::vector<NetworkProblem>& problems) {
+	if (!(a.flags & b.flags & NF_HIGHWAY) || ((a.flags | b.flags) & (NF_BRIDGE|NF_TUNNEL)) || a.layer != b.layer)
+		return;
+
+	network_problem(problems, N_CROSSING, "default", a.id, b.id, new OGRPoint(location.lon(), location.lat()),
+		"Crossing highway on layer %d without a shared node", a.layer);
+}
+
+// Splits 0..count into one range per thread and calls function(begin, end) on each
+template <typename TFunction>
+inline void parallel_ranges(unsigned int threads, size_t count, TFunction function) {
+	std::vector<std::thread>	workers;
+	size_t				step=(count+threads-1)/threads;
+
+	for(unsigned int i=1;i<threads;i++) {
+		workers.emplace_back(function, std::min(count, i*step), std::min(count, (i+1)*step));
+	}
+	function(0, std::min(count, step));
+
+	for(auto& t : workers) {
+		t.join();
+	}
+}
+
+static const uint32_t	network_nonode=std::numeric_limits<uint32_t>::max();
+
+/*
+ * Node to way adjacency of the highways as compressed sparse rows. The
+ * highway nodes are numbered in the order of their ids and the ways of node
+ * n are ways[offsets[n]] up to ways[offsets[n+1]]. waynodes has the number
+ * of every node in NetworkCollector::nodes - network_nonode for railways and
+ * waterways. About 16 bytes per highway node.
+ */
+class NetworkGraph {
+	public:
+		std::vector<osmium::object_id_type>	ids;
+		std::vector<uint32_t>			offsets;
+		std::vector<uint32_t>			ways;
+		std::vector<uint32_t>			waynodes;
+
+		NetworkGraph(const NetworkCollector& network, unsigned int threads) {
+			for(size_t way=0;way<network.ways.size();way++) {
+				if (!(network.ways[way].flags & NF_HIGHWAY))
+					continue;
+				for(const NetworkNode *n=network.begin(way);n != network.end(way);n++) {
+					ids.push_back(n->id);
+				}
+			}
+
+			std::sort(ids.begin(), ids.end());
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			ids.shrink_to_fit();
+
+			if (ids.size() >= network_nonode)
+				throw std::runtime_error("too many highway nodes in the network");
+
+			waynodes.assign(network.nodes.size(), network_nonode);
+			parallel_ranges(threads, network.ways.size(), [&](size_t begin, size_t end) {
+				for(size_t way=begin;way<end;way++) {
+					if (!(network.ways[way].flags & NF_HIGHWAY))
+						continue;
+					for(const NetworkNode *n=network.begin(way);n != network.end(way);n++) {
+						waynodes[n-network.nodes.data()]=static_cast<uint32_t>(std::lower_bound(ids.begin(), ids.end(), n->id)-ids.begin());
+					}
+				}
+			});
+
+			offsets.assign(ids.size()+1, 0);
+			size_t	incidences=0;
+			for(uint32_t node : waynodes) {
+				if (node != network_nonode) {
+					offsets[node+1]++;
+					incidences++;
+				}
+			}
+
+			if (incidences >= network_nonode)
+				throw std::runtime_error("too many highway node references in the network");
+			for(size_t i=1;i<offsets.size();i++) {
+				offsets[i]+=offsets[i-1];
+			}
+
+			// Filled in way order so a way passing a node twice is next to itself
+			std::vector<uint32_t>	fill(offsets.begin(), offsets.end()-1);
+			ways.resize(offsets.back());
+			for(size_t way=0;way<network.ways.size();way++) {
+				for(const NetworkNode *n=network.begin(way);n != network.end(way);n++) {
+					uint32_t	node=waynodes[n-network.nodes.data()];
+
+					if (node != network_nonode)
+						ways[fill[node]++]=static_cast<uint32_t>(way);
+				}
+			}
+			fill.clear();
+			fill.shrink_to_fit();
+
+			// Every way only once per node
+			uint32_t	out=0;
+			for(size_t node=0;node<ids.size();node++) {
+				uint32_t	begin=offsets[node], end=offsets[node+1];
+
+				offsets[node]=out;
+				for(uint32_t i=begin;i<end;i++) {
+					if (i == begin || ways[i] != ways[i-1])
+						ways[out++]=ways[i];
+				}
+			}
+			offsets.back()=out;
+			ways.resize(out);
+			ways.shrink_to_fit();
+		}
+
+		const uint32_t *begin(uint32_t node) const {
+			return ways.data()+offsets[node];
+		}
+
+		const uint32_t *end(uint32_t node) const {
+			return ways.data()+offsets[node+1];
+		}
+};
+
+/*
+ * Union find used by all threads at once - the parents are only changed by
+ * compare and swap. The root of a set is always its smallest member.
+ */
+class ConcurrentUnionFind {
+	std::unique_ptr<std::atomic<uint32_t>[]>	parent;
+
+	public:
+		explicit ConcurrentUnionFind(size_t size) : parent(new std::atomic<uint32_t>[size]) {
+			for(size_t i=0;i<size;i++) {
+				parent[i].store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+			}
+		}
+
+		uint32_t find(uint32_t x) {
+			while (true) {
+				uint32_t	p=parent[x].load(std::memory_order_relaxed);
+				if (p == x)
+					return x;
+
+				// Path halving - fails harmlessly if another thread was faster
+				uint32_t	gp=parent[p].load(std::memory_order_relaxed);
+				if (gp != p)
+					parent[x].compare_exchange_weak(p, gp);
+				x=gp;
+			}
+		}
+
+		void unite(uint32_t a, uint32_t b) {
+			while (true) {
+				a=find(a);
+				b=find(b);
+				if (a == b)
+					return;
+				if (a < b)
+					std::swap(a, b);
+
+				// Fails if a got linked meanwhile - then try again from its new root
+				uint32_t	expected=a;
+				if (parent[a].compare_exchange_strong(expected, b))
+					return;
+			}
+		}
+};
+
+inline OGRLineString *network_linestring(const NetworkCollector& network, size_t way) {
+	OGRLineString		*linestring=new OGRLineString();
+	osmium::Location	last;
+
+	for(const NetworkNode *n=network.begin(way);n != network.end(way);n++) {
+		if (!n->location.valid() || n->location == last)
+			continue;
+		linestring->addPoint(n->location.lon(), n->location.lat());
+		last=n->location;
+	}
+
+	return linestring;
+}
+
+/*
+ * Highways not connected to the rest of the network. The ways sharing a node
+ * are united on all threads, then every public road in a component of at
+ * most islandways ways is reported. The largest component is the network
+ * itself and never an island. other is the smallest way id of the island,
+ * not its root which is only the first way of it in the input.
+ */
+inline void check_islands(const NetworkCollector& network, const NetworkGraph& graph,
+		unsigned int threads, size_t islandways, std::vector<NetworkProblem>& problems) {
+	ConcurrentUnionFind	components(network.ways.size());
+
+	parallel_ranges(threads, graph.ids.size(), [&](size_t begin, size_t end) {
+		for(size_t node=begin;node<end;node++) {
+			for(const uint32_t *way=graph.begin(node)+1;way < graph.end(node);way++) {
+				components.unite(*graph.begin(node), *way);
+			}
+		}
+	});
+
+	std::vector<uint32_t>			size(network.ways.size(), 0);
+	std::vector<osmium::object_id_type>	smallest(network.ways.size(), std::numeric_limits<osmium::object_id_type>::max());
+	uint32_t				largest=0;
+
+	for(size_t way=0;way<network.ways.size();way++) {
+		if (!(network.ways[way].flags & NF_HIGHWAY))
+			continue;
+
+		uint32_t	root=components.find(way);
+		size[root]++;
+		smallest[root]=std::min(smallest[root], network.ways[way].id);
+		if (size[root] > size[largest])
+			largest=root;
+	}
+
+	for(size_t way=0;way<network.ways.size();way++) {
+		const NetworkWay&	w=network.ways[way];
+
+		if ((w.flags & (NF_HIGHWAY|NF_PUBLIC)) != (NF_HIGHWAY|NF_PUBLIC))
+			continue;
+
+		uint32_t	root=components.find(way);
+		if (root == largest || size[root] > islandways)
+			continue;
+
+		network_problem(problems, N_ISLAND, "default", w.id, smallest[root], network_linestring(network, way),
+			"Road island of %u ways not connected to the network", size[root]);
+	}
+}
+
+/*
+ * Oneway traps - the roads for motor vehicles as a directed graph of their
+ * nodes, oneways only have the edge in their direction. The strongly
+ * connected components are found with Tarjan's algorithm on an explicit
+ * stack. On the graph of the components a search from the largest one
+ * marks what can be reached, one on the reversed edges what can reach it.
+ * A component with only the first mark is a trap, one with only the second
+ * can not be reached. Components with neither are islands.
+ */
+class OnewayGraph {
+	std::vector<uint32_t>	offsets;
+	std::vector<uint32_t>	targets;
+
+	template <typename TFunction>
+	static void edges(const NetworkCollector& network, const NetworkGraph& graph, TFunction function) {
+		for(size_t way=0;way<network.ways.size();way++) {
+			uint16_t	flags=network.ways[way].flags;
+
+			if (!(flags & NF_VEHICLE))
+				continue;
+
+			const uint32_t	*node=graph.waynodes.data()+network.ways[way].first;
+			size_t		count=network.end(way)-network.begin(way);
+
+			for(size_t i=0;i+1<count;i++) {
+				if (node[i] == node[i+1])
+					continue;
+				if (!(flags & NF_REVERSE))
+					function(node[i], node[i+1]);
+				if (!(flags & NF_ONEWAY))
+					function(node[i+1], node[i]);
+			}
+		}
+	}
+
+	public:
+		// The component of every node
+		std::vector<uint32_t>	component;
+		uint32_t		components=0;
+
+		OnewayGraph(const NetworkCollector& network, const NetworkGraph& graph) {
+			offsets.assign(graph.ids.size()+1, 0);
+			edges(network, graph, [&](uint32_t from, uint32_t) {
+				offsets[from+1]++;
+			});
+			for(size_t i=1;i<offsets.size();i++) {
+				offsets[i]+=offsets[i-1];
+			}
+
+			std::vector<uint32_t>	fill(offsets.begin(), offsets.end()-1);
+			targets.resize(offsets.back());
+			edges(network, graph, [&](uint32_t from, uint32_t to) {
+				targets[fill[from]++]=to;
+			});
+		}
+
+		const uint32_t *begin(uint32_t node) const {
+			return targets.data()+offsets[node];
+		}
+
+		const uint32_t *end(uint32_t node) const {
+			return targets.data()+offsets[node+1];
+		}
+
+		void strongly_connected() {
+			size_t					nodes=offsets.size()-1;
+			std::vector<uint32_t>			index(nodes, network_nonode);
+			std::vector<uint32_t>			lowlink(nodes);
+			std::vector<uint32_t>			stack;
+			std::vector<std::pair<uint32_t, const uint32_t *>>	calls;
+			uint32_t				next=0;
+
+			component.assign(nodes, network_nonode);
+
+			// A node is on the stack while it has an index but no component
+			auto visit=[&](uint32_t node) {
+				index[node]=lowlink[node]=next++;
+				stack.push_back(node);
+				calls.emplace_back(node, begin(node));
+			};
+
+			for(uint32_t root=0;root<nodes;root++) {
+				if (index[root] != network_nonode)
+					continue;
+
+				visit(root);
+				while (!calls.empty()) {
+					uint32_t	node=calls.back().first;
+
+					if (calls.back().second != end(node)) {
+						uint32_t	target=*calls.back().second++;
+
+						if (index[target] == network_nonode) {
+							visit(target);
+						} else if (component[target] == network_nonode) {
+							lowlink[node]=std::min(lowlink[node], index[target]);
+						}
+						continue;
+					}
+
+					calls.pop_back();
+					if (!calls.empty())
+						lowlink[calls.back().first]=std::min(lowlink[calls.back().first], lowlink[node]);
+
+					if (lowlink[node] == index[node]) {
+						uint32_t	member;
+						do {
+							member=stack.back();
+							stack.pop_back();
+							component[member]=components;
+						} while (member != node);
+						components++;
+					}
+				}
+			}
+		}
+};
+
+// Mark the components reachable from start over the edges between components
+inline std::vector<uint8_t> component_reach(const std::vector<std::pair<uint32_t, uint32_t>>& edges,
+		uint32_t components, uint32_t start) {
+	std::vector<uint32_t>	offsets(components+1, 0);
+	std::vector<uint32_t>	targets(edges.size());
+
+	for(const auto& e : edges) {
+		offsets[e.first+1]++;
+	}
+	for(size_t i=1;i<offsets.size();i++) {
+		offsets[i]+=offsets[i-1];
+	}
+
+	std::vector<uint32_t>	fill(offsets.begin(), offsets.end()-1);
+	for(const auto& e : edges) {
+		targets[fill[e.first]++]=e.second;
+	}
+
+	std::vector<uint8_t>	reached(components, 0);
+	std::vector<uint32_t>	queue{start};
+
+	reached[start]=1;
+	for(size_t i=0;i<queue.size();i++) {
+		for(uint32_t j=offsets[queue[i]];j<offsets[queue[i]+1];j++) {
+			if (!reached[targets[j]]) {
+				reached[targets[j]]=1;
+				queue.push_back(targets[j]);
+			}
+		}
+	}
+
+	return reached;
+}
+
+inline void check_oneway_traps(const NetworkCollector& network, const NetworkGraph& graph, std::vector<NetworkProblem>& problems) {
+	OnewayGraph	oneway(network, graph);
+	oneway.strongly_connected();
+
+	std::vector<uint32_t>				size(oneway.components, 0);
+	std::vector<std::pair<uint32_t, uint32_t>>	edges;
+
+	for(uint32_t node=0;node<oneway.component.size();node++) {
+		uint32_t	from=oneway.component[node];
+
+		size[from]++;
+		for(const uint32_t *target=oneway.begin(node);target != oneway.end(node);target++) {
+			uint32_t	to=oneway.component[*target];
+			if (to != from)
+				edges.emplace_back(from, to);
+		}
+	}
+
+	if (!oneway.components)
+		return;
+
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	uint32_t		largest=std::max_element(size.begin(), size.end())-size.begin();
+	std::vector<uint8_t>	entered=component_reach(edges, oneway.components, largest);
+
+	for(auto& e : edges) {
+		std::swap(e.first, e.second);
+	}
+	std::vector<uint8_t>	leaves=component_reach(edges, oneway.components, largest);
+
+	for(size_t way=0;way<network.ways.size();way++) {
+		if (!(network.ways[way].flags & NF_VEHICLE))
+			continue;
+
+		const uint32_t	*node=graph.waynodes.data()+network.ways[way].first;
+		size_t		count=network.end(way)-network.begin(way);
+
+		for(size_t i=0;i<count;i++) {
+			uint32_t	c=oneway.component[node[i]];
+
+			if (leaves[c] == entered[c])
+				continue;
+
+			network_problem(problems, N_ONEWAY, "default", network.ways[way].id, 0, network_linestring(network, way),
+				entered[c] ? "Oneway trap - can be entered but not left" : "Oneway trap - can be left but not entered");
+			break;
+		}
+	}
+}
+
+/*
+ * Sharp angles between public roads at their junctions. The arms of the
+ * junctions are collected as vectors in metres into plain arrays and
+ * acute_arms compares every pair against the limit without sqrt or acos,
+ * so the compiler vectorizes it. Only the few acute pairs get their angle
+ * computed. Links and oneways split and merge at acute angles on purpose
+ * so they are left out.
+ */
+struct JunctionPair {
+	uint32_t		node;
+	uint32_t		way;
+	uint32_t		other;
+	osmium::Location	location;
+};
+
+inline void acute_arms(const float * __restrict__ ax, const float * __restrict__ ay,
+		const float * __restrict__ bx, const float * __restrict__ by,
+		uint8_t * __restrict__ acute, size_t count, float cos2) {
+	for(size_t i=0;i<count;i++) {
+		float	dot=ax[i]*bx[i]+ay[i]*by[i];
+		float	lengths=(ax[i]*ax[i]+ay[i]*ay[i])*(bx[i]*bx[i]+by[i]*by[i]);
+
+		acute[i]=(dot > 0) & (dot*dot > cos2*lengths);
+	}
+}
+
+class JunctionAngles {
+	static const size_t	batchsize=4096;
+
+	const NetworkCollector	&network;
+	const NetworkGraph	&graph;
+	float			limit;		// Degrees
+
+	struct Arm {
+		float		x, y;
+		uint32_t	way;
+	};
+
+	std::vector<Arm>		arms;
+	std::vector<float>		ax, ay, bx, by;
+	std::vector<uint8_t>		acute;
+	std::vector<JunctionPair>	pairs;
+
+	static bool wanted(const NetworkWay& way) {
+		return (way.flags & (NF_PUBLIC|NF_LINK|NF_ONEWAY)) == NF_PUBLIC;
+	}
+
+	osmium::Location	location;
+
+	void arm(osmium::Location junction, const NetworkNode& node, float coslat, uint32_t way) {
+		if (!node.location.valid() || node.location == junction)
+			return;
+
+		// Degrees of 1e-7 to metres - flat around the junction
+		arms.push_back(Arm{
+			static_cast<float>((node.location.x()-junction.x())*0.0111320*coslat),
+			static_cast<float>((node.location.y()-junction.y())*0.0111320),
+			way});
+	}
+
+	void junction(uint32_t node) {
+		if (graph.end(node)-graph.begin(node) < 2)
+			return;
+
+		arms.clear();
+		for(const uint32_t *w=graph.begin(node);w != graph.end(node);w++) {
+			if (!wanted(network.ways[*w]))
+				continue;
+
+			const NetworkNode	*begin=network.begin(*w);
+			const uint32_t		*waynode=graph.waynodes.data()+network.ways[*w].first;
+			size_t			count=network.end(*w)-begin;
+
+			for(size_t i=0;i<count;i++) {
+				if (waynode[i] != node || !begin[i].location.valid())
+					continue;
+
+				float	coslat=std::cos(begin[i].location.lat()*M_PI/180);
+				location=begin[i].location;
+				if (i > 0)
+					arm(begin[i].location, begin[i-1], coslat, *w);
+				if (i+1 < count)
+					arm(begin[i].location, begin[i+1], coslat, *w);
+			}
+		}
+
+		for(size_t a=0;a<arms.size();a++) {
+			for(size_t b=a+1;b<arms.size();b++) {
+				if (arms[a].way == arms[b].way)
+					continue;
+				ax.push_back(arms[a].x);
+				ay.push_back(arms[a].y);
+				bx.push_back(arms[b].x);
+				by.push_back(arms[b].y);
+				pairs.push_back(JunctionPair{node, arms[a].way, arms[b].way, location});
+			}
+		}
+	}
+
+	// The sharpest acute pair of every junction
+	void flush(std::vector<NetworkProblem>& problems) {
+		float	limitcos=std::cos(limit*M_PI/180);
+
+		acute.resize(pairs.size());
+		acute_arms(ax.data(), ay.data(), bx.data(), by.data(), acute.data(), pairs.size(), limitcos*limitcos);
+
+		for(size_t i=0;i<pairs.size();) {
+			size_t	sharpest=pairs.size();
+			float	angle=limit;
+			size_t	j=i;
+
+			for(;j<pairs.size() && pairs[j].node == pairs[i].node;j++) {
+				if (!acute[j])
+					continue;
+
+				float	a=std::acos(std::min(1.0f, (ax[j]*bx[j]+ay[j]*by[j])
+						/std::sqrt((ax[j]*ax[j]+ay[j]*ay[j])*(bx[j]*bx[j]+by[j]*by[j]))))*180/M_PI;
+				if (sharpest == pairs.size() || a < angle) {
+					sharpest=j;
+					angle=a;
+				}
+			}
+
+			if (sharpest != pairs.size()) {
+				const JunctionPair&	p=pairs[sharpest];
+
+				network_problem(problems, N_ANGLE, "default", network.ways[p.way].id, network.ways[p.other].id,
+					new OGRPoint(p.location.lon(), p.location.lat()),
+					"Sharp angle of %.0f degrees between public roads", angle);
+			}
+			i=j;
+		}
+
+		ax.clear();
+		ay.clear();
+		bx.clear();
+		by.clear();
+		pairs.clear();
+	}
+
+	public:
+		JunctionAngles(const NetworkCollector& network, const NetworkGraph& graph, float limit) :
+			network(network), graph(graph), limit(limit) {}
+
+		void run(size_t begin, size_t end, std::vector<NetworkProblem>& problems) {
+			for(size_t node=begin;node<end;node++) {
+				junction(static_cast<uint32_t>(node));
+				if (pairs.size() >= batchsize)
+					flush(problems);
+			}
+			flush(problems);
+		}
+};
+
+inline void check_junction_angles(const NetworkCollector& network, const NetworkGraph& graph,
+		unsigned int threads, float limit, std::vector<NetworkProblem>& problems) {
+	std::mutex	lock;
+
+	parallel_ranges(threads, graph.ids.size(), [&](size_t begin, size_t end) {
+		JunctionAngles			angles(network, graph, limit);
+		std::vector<NetworkProblem>	found;
+
+		angles.run(begin, end, found);
+
+		std::lock_guard<std::mutex>	guard(lock);
+		std::move(found.begin(), found.end(), std::back_inserter(problems));
+	});
+}
+
+/*
+ * Tags of nodes on highways and at junctions - traffic signs, turning
+ * circles or noexit. Where they have to be is compared with the node to
+ * way index of the highways.
+ */
+static const double	network_sign_distance=30;	// Metres from a stop or give way to the junction
+
+inline double network_distance(osmium::Location a, osmium::Location b) {
+	double	coslat=std::cos(a.lat()*M_PI/180);
+	double	dx=(b.x()-double(a.x()))*0.0111320*coslat;
+	double	dy=(b.y()-double(a.y()))*0.0111320;
+
+	return std::sqrt(dx*dx+dy*dy);
+}
+
+// Number of ways at the node with any of the flags
+inline size_t network_ways(const NetworkCollector& network, const NetworkGraph& graph, uint32_t node, uint16_t flags) {
+	return std::count_if(graph.begin(node), graph.end(node),
+		[&](uint32_t way) { return (network.ways[way].flags & flags) != 0; });
+}
+
+// Metres along the way from node to the next junction of ways with the flags or end of the way
+inline double junction_distance(const NetworkCollector& network, const NetworkGraph& graph, size_t way, size_t node, uint16_t flags) {
+	const NetworkNode	*begin=network.begin(way);
+	const uint32_t		*waynode=graph.waynodes.data()+network.ways[way].first;
+	ptrdiff_t		count=network.end(way)-begin;
+	double			best=std::numeric_limits<double>::infinity();
+
+	for(int step : { -1, 1 }) {
+		double	distance=0;
+
+		for(ptrdiff_t i=node+step;i >= 0 && i < count;i+=step) {
+			if (begin[i].location.valid() && begin[i-step].location.valid())
+				distance+=network_distance(begin[i-step].location, begin[i].location);
+
+			if (i == 0 || i == count-1 || network_ways(network, graph, waynode[i], flags) > 1) {
+				best=std::min(best, distance);
+				break;
+			}
+		}
+	}
+
+	return best;
+}
+
+inline void check_points(const NetworkCollector& network, const NetworkGraph& graph, std::vector<NetworkProblem>& problems) {
+	for(const auto& point : network.points) {
+		auto	id=std::lower_bound(graph.ids.begin(), graph.ids.end(), point.id);
+
+		if (id == graph.ids.end() || *id != point.id) {
+			network_problem(problems, N_NODE, "default", point.id, 0, new OGRPoint(point.location.lon(), point.location.lat()),
+				"%s=%s is not on a highway", point.key, point.value);
+			continue;
+		}
+
+		uint32_t	node=id-graph.ids.begin();
+		size_t		ways=graph.end(node)-graph.begin(node);
+
+		// Footways or paths at a road do not make a junction or end
+		const uint32_t	*vehicle=std::find_if(graph.begin(node), graph.end(node),
+					[&](uint32_t way) { return (network.ways[way].flags & NF_VEHICLE) != 0; });
+		uint16_t	kind=(vehicle != graph.end(node)) ? NF_VEHICLE : NF_HIGHWAY;
+		size_t		roads=network_ways(network, graph, node, kind);
+		size_t		way=(vehicle != graph.end(node)) ? *vehicle : *graph.begin(node);
+		const uint32_t	*waynode=graph.waynodes.data()+network.ways[way].first;
+		size_t		count=network.end(way)-network.begin(way);
+		size_t		pos=std::find(waynode, waynode+count, node)-waynode;
+		bool		end=(pos == 0 || waynode[count-1] == node);
+
+		switch(point.rule) {
+			case NP_ONROAD:
+				break;
+			case NP_JUNCTION:
+				if (ways < 2)
+					network_problem(problems, N_NODE, "default", point.id, network.ways[way].id,
+						new OGRPoint(point.location.lon(), point.location.lat()),
+						"%s=%s is not at a junction", point.key, point.value);
+				break;
+			case NP_END:
+				if (roads > 1 || !end)
+					network_problem(problems, N_NODE, "default", point.id, network.ways[way].id,
+						new OGRPoint(point.location.lon(), point.location.lat()),
+						"%s=%s is not at the end of a highway", point.key, point.value);
+				break;
+			case NP_NEARJUNCTION: {
+				if (roads > 1 || end)
+					break;
+
+				double	distance=junction_distance(network, graph, way, pos, kind);
+				if (distance > network_sign_distance)
+					network_problem(problems, N_NODE, "default", point.id, network.ways[way].id,
+						new OGRPoint(point.location.lon(), point.location.lat()),
+						"%s=%s is %.0fm away from the next junction", point.key, point.value, distance);
+				break;
+			}
+		}
+	}
+}
+
+struct NetworkOptions {
+	unsigned int	threads;
+	size_t		islandways;	// Largest road island reported
+	float		junctionangle;	// Degrees - sharper angles between roads are reported
+};
+
+/*
+ * Runs the network checks once all ways were read. The problems are sorted
+ * so the output does not depend on the number of threads.
+ */
+inline std::vector<NetworkProblem> network_checks(const NetworkCollector& network, const NetworkOptions& options) {
+	unsigned int					threads=options.threads ? options.threads : 1;
+	std::vector<std::vector<NetworkProblem>>	found(threads);
+
+	{
+		NetworkCrossings	crossings(network);
+		crossings.run(threads, [&](unsigned int num) {
+			std::vector<NetworkProblem>	*problems=&found[num];
+
+			return [problems](const NetworkWay& a, const NetworkWay& b, osmium::Location location) {
+				check_layering(a, b, location, *problems);
+				check_crossing(a, b, location, *problems);
+			};
+		});
+	}
+
+	std::vector<NetworkProblem>	problems;
+	for(auto& f : found) {
+		std::move(f.begin(), f.end(), std::back_inserter(problems));
+	}
+
+	NetworkGraph	graph(network, threads);
+	check_islands(network, graph, threads, options.islandways, problems);
+	check_oneway_traps(network, graph, problems);
+	check_junction_angles(network, graph, threads, options.junctionangle, problems);
+	check_points(network, graph, problems);
+
+	std::sort(problems.begin(), problems.end(), [](const NetworkProblem& a, const NetworkProblem& b) {
+		return std::tie(a.lid, a.id, a.other, a.problem) < std::tie(b.lid, b.id, b.other, b.problem);
+	});
+
+	return problems;
+}
+
+/*
+ * Two pass mode - The first pass only reads the ways and remembers the
+ * nodes of all highways we care about. On the second pass only the
+ * locations of these nodes are stored in the index.
+ */
+using node_id_set_type = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+class HighwayNodeCollector : public osmium::handler::Handler {
+	node_id_set_type	&ids;
+	bool			network;
+
+	public:
+		// The network checks also need the nodes of railways and waterways
+		explicit HighwayNodeCollector(node_id_set_type &ids, bool network=false) : ids(ids), network(network) {};
+
+		void way(const osmium::Way& way) {
+			extendedTagList	taglist(way.tags());
+
+			if (!WayHandler::highway_wecare(taglist) && !(network && NetworkCollector::kind(taglist)))
+				return;
+
+			for(const auto& nr : way.nodes()) {
+				ids.set(nr.positive_ref());
+			}
+		}
+};
+
+/*
+ * A reused index already has the locations of all nodes. The nodes are only
+ * read for the network checks and are not stored again.
+ */
+class IndexedNodeLocations : public osmium::handler::Handler {
+	location_handler_type	&location_handler;
+
+	public:
+		explicit IndexedNodeLocations(location_handler_type &location_handler) :
+			location_handler(location_handler) {};
+
+		void way(osmium::Way& way) {
+			location_handler.way(way);
+		}
+};
+
+class HighwayNodeLocations : public osmium::handler::Handler {
+	location_handler_type	&location_handler;
+	const node_id_set_type	&ids;
+
+	public:
+		HighwayNodeLocations(location_handler_type &location_handler, const node_id_set_type &ids) :
+			location_handler(location_handler), ids(ids) {};
+
+		void node(const osmium::Node& node) {
+			if (ids.get(node.positive_id()))
+				location_handler.node(node);
+		}
+
+		void way(osmium::Way& way) {
+			location_handler.way(way);
+		}
+};
+
+/*
+ * Update mode - Reads OSM change files. Node locations go straight into
+ * the location index, the ids of nodes which really moved are remembered.
+ * The last version of every changed way is copied into a buffer.
+ */
+class ChangeCollector : public osmium::handler::Handler {
+	index_type					&index;
+
+	public:
+		osmium::memory::Buffer			buffer{1024*1024, osmium::memory::Buffer::auto_grow::yes};
+		std::map<osmium::object_id_type, size_t>	ways;
+		std::unordered_set<osmium::unsigned_object_id_type>	moved;
+
+		explicit ChangeCollector(index_type &index) : index(index) {};
+
+		void node(const osmium::Node& node) {
+			// Ways using a deleted node will be changed as well
+			if (node.deleted())
+				return;
+
+			if (index.get_noexcept(node.positive_id()) != node.location()) {
+				index.set(node.positive_id(), node.location());
+				moved.insert(node.positive_id());
+			}
+		}
+
+		void way(const osmium::Way& way) {
+			auto it=ways.find(way.id());
+			if (it != ways.end() && buffer.get<osmium::Way>(it->second).version() > way.version())
+				return;
+
+			size_t	offset=buffer.committed();
+			buffer.add_item(way);
+			buffer.commit();
+
+			ways[way.id()]=offset;
+		}
+};
+
+/*
+ * Check threads. The buffers are read and get their node locations
+ * on the main thread, then they are queued to the workers which each run
+ * their own WayHandler. The problems come back through a future per buffer
+ * so the writer sees them in the same order as a single threaded run.
+ */
+struct CheckJob {
+	osmium::memory::Buffer			buffer;
+	std::promise<std::vector<WayProblems>>	result;
+};
+
+class CheckWorkers {
+	osmium::thread::Queue<CheckJob>	queue;
+	std::vector<std::thread>	threads;
+	std::vector<CheckStats>		stats;
+	CheckOptions			options;
+
+	void worker(unsigned int num) {
+		ProblemCollector	collector(options.keepnodes);
+		WayHandler		handler(collector, stats.empty() ? nullptr : &stats[num], options);
+
+		while (true) {
+			CheckJob	job;
+			queue.wait_and_pop(job);
+
+			// An invalid buffer marks the end of input
+			if (!job.buffer)
+				return;
+
+			try {
+				osmium::apply(job.buffer, handler);
+				job.result.set_value(collector.release());
+			} catch (...) {
+				job.result.set_exception(std::current_exception());
+			}
+		}
+	}
+
+	public:
+		CheckWorkers(unsigned int num, const CheckOptions& options=CheckOptions{}) :
+				queue(num*2, "check"), options(options) {
+			if (options.stats)
+				stats.resize(num);
+
+			for(unsigned int i=0;i<num;i++) {
+				threads.emplace_back(&CheckWorkers::worker, this, i);
+			}
+		}
+
+		~CheckWorkers() {
+			close();
+		}
+
+		void close() {
+			for(size_t i=0;i<threads.size();i++) {
+				queue.push(CheckJob{});
+			}
+			for(auto& t : threads) {
+				t.join();
+			}
+			threads.clear();
+		}
+
+		// Merged counters of all threads - only valid after close()
+		CheckStats statistics() const {
+			CheckStats	result;
+
+			for(const auto& s : stats) {
+				result.merge(s);
+			}
+			return result;
+		}
+
+		std::future<std::vector<WayProblems>> submit(osmium::memory::Buffer&& buffer) {
+			CheckJob	job;
+
+			job.buffer=std::move(buffer);
+			std::future<std::vector<WayProblems>> future=job.result.get_future();
+			queue.push(std::move(job));
+
+			return future;
+		}
+};
+
+inline void write_stats(const CheckStats& stats, SpatiaLiteWriter& writer) {
+	for(size_t i=0;i<stats.checks.size();i++) {
+		const CheckCounter&	counter=stats.checks[i];
+
+		writer.writeStat("check", WayHandler::checks()[i].name, counter.calls, counter.problems,
+			std::chrono::duration<double>(counter.time).count());
+	}
+	for(size_t i=0;i<stats.layers.size();i++) {
+		writer.writeStat("layer", writer.layernames()[i], 0, stats.layers[i], 0);
+	}
+	writer.writeStat("memo", "hits", stats.memo_hits, 0, 0);
+	writer.writeStat("memo", "misses", stats.memo_misses, 0, 0);
+}
+
+/*
+ * Summary table of the --stats counters
+ */
+inline void print_stats(const CheckStats& stats, const std::array<std::string, layermax>& layername, std::ostream& out) {
+	out << std::left << std::setw(24) << "check"
+		<< std::right << std::setw(12) << "calls"
+		<< std::setw(12) << "problems"
+		<< std::setw(12) << "seconds" << std::endl;
+
+	for(size_t i=0;i<stats.checks.size();i++) {
+		const CheckCounter&	counter=stats.checks[i];
+
+		out << std::left << std::setw(24) << WayHandler::checks()[i].name
+			<< std::right << std::setw(12) << counter.calls
+			<< std::setw(12) << counter.problems
+			<< std::setw(12) << std::fixed << std::setprecision(3)
+			<< std::chrono::duration<double>(counter.time).count() << std::endl;
+	}
+
+	out << std::endl << std::left << std::setw(24) << "layer"
+		<< std::right << std::setw(12) << "problems" << std::endl;
+
+	for(size_t i=0;i<stats.layers.size();i++) {
+		out << std::left << std::setw(24) << layername[i]
+			<< std::right << std::setw(12) << stats.layers[i] << std::endl;
+	}
+
+	uint64_t	lookups=stats.memo_hits+stats.memo_misses;
+	if (lookups) {
+		out << std::endl << "tag set memo hits " << stats.memo_hits << " of " << lookups
+			<< std::fixed << std::setprecision(1) << " (" << 100.0*stats.memo_hits/lookups << "%)" << std::endl;
+	}
+}
+
+#endif // WAYPROBLEMS_HPP